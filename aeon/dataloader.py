@@ -92,6 +92,7 @@ class DataLoader(object):
 
         self.loaderlib.stop.argtypes = [ct.c_void_p]
         self.loaderlib.reset.argtypes = [ct.c_void_p]
+        self.loaderlib.seek.argtypes = [ct.c_void_p, ct.c_int, ct.c_int]
         self.loaderlib.itemCount.argtypes = [ct.c_void_p]
         self.loaderlib.itemCount.restype = ct.c_int
 
@@ -172,6 +173,13 @@ class DataLoader(object):
         if self.loaderlib.reset(self.loader) == -1:
             self._raise_loader_error()
 
+    def _seek(self, epoch, batch):
+        """
+        C api wrapper with exception handling
+        """
+        if self.loaderlib.seek(self.loader, epoch, batch) == -1:
+            self._raise_loader_error()
+
     @property
     def item_count(self):
         """
@@ -195,6 +203,27 @@ class DataLoader(object):
 
         self._reset()
 
+    def seek(self, epoch, batch):
+        """
+        Continue at minibatch `batch` of epoch `epoch` as counted by __iter__,
+        e.g. to resume training from a checkpoint.  The minibatches and their
+        random transforms are the same as those of a loader that was iterated
+        up to that point, without reading or decoding what comes before.
+        """
+        # items of this epoch already used to fill the last minibatch of the
+        # previous one
+        first_batch = -((-epoch * self.item_count) // self.minibatch_size)
+        item_index = first_batch * self.minibatch_size - epoch * self.item_count
+        item_index += batch * self.minibatch_size
+        if epoch < 0 or batch < 0 or item_index >= self.item_count:
+            raise ValueError('epoch {} has no minibatch {}'.format(epoch, batch))
+
+        self._seek(epoch, batch)
+
+        self._buffer_id = 0
+        self._item_index = item_index
+        self._compute_nbatches()
+
     def next(self):
         """
         return one minibatch in a (data, targets) tuple
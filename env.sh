@@ -4,11 +4,15 @@ SRCS="
     api.cpp
     avi.cpp
     batch_iterator.cpp
+    block_iterator_global_shuffle.cpp
     block_iterator_sequential.cpp
+    block_iterator_shuffle_buffer.cpp
     block_iterator_shuffled.cpp
     block_loader.cpp
     block_loader_cpio_cache.cpp
     block_loader_file.cpp
+    block_loader_memory_cache.cpp
+    block_loader_packed_cache.cpp
     block_loader_nds.cpp
     box.cpp
     buffer_in.cpp
@@ -16,8 +20,12 @@ SRCS="
     buffer_pool.cpp
     buffer_pool_in.cpp
     buffer_pool_out.cpp
+    cache_eviction.cpp
     cap_mjpeg_decoder.cpp
     cpio.cpp
+    cpio_record_index.cpp
+    crop_resize.cpp
+    decoded_cache.cpp
     etl_audio.cpp
     etl_boundingbox.cpp
     etl_char_map.cpp
@@ -29,13 +37,18 @@ SRCS="
     etl_depthmap.cpp
     etl_video.cpp
     file_util.cpp
+    half.cpp
     image.cpp
     interface.cpp
+    jpeg.cpp
     loader.cpp
     log.cpp
     manifest_csv.cpp
     manifest_nds.cpp
     noise_clips.cpp
+    output_cache.cpp
+    packed_file.cpp
+    photometric.cpp
     provider_audio_classifier.cpp
     provider_audio_only.cpp
     provider_audio_transcriber.cpp
@@ -75,7 +88,16 @@ if [[ $? == 0 ]]; then
 	export IMGLIBS="$IMGLIBS $(pkg-config --libs-only-l sox)"
 fi
 
-export MEDIAFLAGS="${IMGFLAG}"
+# libjpeg is used directly for reduced resolution JPEG decoding
+pkg-config --exists libjpeg
+if [[ $? == 0 ]]; then
+    export JPEGFLAG="-DHAS_LIBJPEG"
+	export INC="$(pkg-config --cflags libjpeg) ${INC}"
+	export IMGLDIR="$IMGLDIR $(pkg-config --libs-only-L libjpeg)"
+	export IMGLIBS="$IMGLIBS $(pkg-config --libs-only-l libjpeg)"
+fi
+
+export MEDIAFLAGS="${IMGFLAG} ${JPEGFLAG}"
 export LDIR="${IMGLDIR}"
 export LIBS="-lsox -lcurl ${IMGLIBS}"
 
@@ -102,6 +102,16 @@ extern int reset(loader* data_loader)
     }
 }
 
+extern int seek(loader* data_loader, int epoch, int batch)
+{
+    try {
+        return data_loader->seek(epoch, batch);
+    } catch(std::exception& ex) {
+        last_error_message = ex.what();
+        return -1;
+    }
+}
+
 extern int stop(loader* data_loader)
 {
     try {
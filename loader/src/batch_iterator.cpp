@@ -21,7 +21,8 @@ batch_iterator::batch_iterator(std::shared_ptr<block_iterator> src_block_iterato
                                int batch_size) :
     _src_block_iterator(src_block_iterator),
     _batch_size(batch_size),
-    _i(0)
+    _i(0),
+    _skip(0)
 {
     // Note that we don't know how many buffer_ins in we will be writing to until this.read()
     // is called.  So we leave our _macrobatch buffer_in_array pointer to null until we get that
@@ -50,13 +51,28 @@ void batch_iterator::reset()
 
     _src_block_iterator->reset();
 
+    _i = 0;
+    _skip = 0;
+}
+
+void batch_iterator::seek(uint32_t epoch, uint32_t record)
+{
+    if(_src_buffer_array_ptr != nullptr) {
+        for (auto m: *_src_buffer_array_ptr) {
+            m->reset();
+        }
+    }
+
+    _skip = _src_block_iterator->seek(epoch, record);
+
     _i = 0;
 }
 
 void batch_iterator::transfer_buffer_item(buffer_in* dst, buffer_in* src)
 {
     try {
-        dst->add_item(src->get_item(_i));
+        // share rather than copy, the source block is reset before it is reused
+        dst->add_item(src->get_shared_item(_i));
     } catch (std::exception& e) {
         dst->add_exception(std::current_exception());
     }
@@ -74,7 +90,8 @@ void batch_iterator::pop_item_from_block(buffer_in_array& dst_buffer_array)
 
         _src_block_iterator->read(src_buffer_array);
 
-        _i = 0;
+        _i = _skip;
+        _skip = 0;
     }
 
     // because the _src_buffer_array_ptr Buffers may have been shuffled, and its shuffle
@@ -32,6 +32,10 @@ public:
 
     void read(nervana::buffer_in_array& dst_buffer_array);
     void reset();
+
+    // continue with record `record` of epoch `epoch` of the block iterator
+    // without reading what comes before it, see block_iterator::seek
+    void seek(uint32_t epoch, uint32_t record);
 protected:
     void pop_item_from_block(nervana::buffer_in_array& dst_buffer_array);
     void transfer_buffer_item(nervana::buffer_in* dst, nervana::buffer_in* src);
@@ -42,4 +46,6 @@ protected:
     std::shared_ptr<nervana::buffer_in_array> _src_buffer_array_ptr;
     // the index into the _macrobatch to read next
     int _i;
+    // items to skip in the next block after a seek
+    int _skip;
 };
@@ -27,4 +27,10 @@ class nervana::block_iterator
 public:
     virtual void read(nervana::buffer_in_array& dest) = 0;
     virtual void reset() = 0;
+
+    // Position the iterator as if, starting right after reset(), `epoch` full
+    // passes and then `record` more records had been read.  Returns the number
+    // of records at the start of the next block read that were already
+    // consumed and must be skipped by the caller.
+    virtual uint32_t seek(uint32_t epoch, uint32_t record) = 0;
 };
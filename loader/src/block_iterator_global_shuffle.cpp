@@ -0,0 +1,113 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include "util.hpp"
+#include "block_iterator_global_shuffle.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_iterator_global_shuffle::block_iterator_global_shuffle(shared_ptr<block_loader> loader) :
+    _loader(loader),
+    _blocks_read(0),
+    _position(0),
+    _epoch(0)
+{
+    if(!open_record_source()) {
+        _block_iterator = make_shared<block_iterator_shuffled>(_loader);
+    }
+}
+
+bool block_iterator_global_shuffle::open_record_source()
+{
+    _records = _loader->get_record_source();
+    if(_records == nullptr) {
+        return false;
+    }
+    affirm(_records->record_count() == _loader->object_count(),
+           "cached record count does not match the dataset");
+
+    _permutation.resize(_records->record_count());
+    shuffle();
+    _position = 0;
+    return true;
+}
+
+void block_iterator_global_shuffle::shuffle()
+{
+    minstd_rand0 rand(get_global_random_seed() + _epoch);
+    iota(_permutation.begin(), _permutation.end(), 0);
+    std::shuffle(_permutation.begin(), _permutation.end(), rand);
+}
+
+void block_iterator_global_shuffle::read(nervana::buffer_in_array& dest)
+{
+    if(_records == nullptr) {
+        // first pass over an incomplete cache
+        _block_iterator->read(dest);
+        if(++_blocks_read == _loader->block_count()) {
+            reset();
+        }
+        return;
+    }
+
+    size_t end = min(_position + _loader->block_size(), _permutation.size());
+    vector<uint64_t> records(_permutation.begin() + _position, _permutation.begin() + end);
+    _records->read_records(dest, records);
+
+    _position = end;
+    if(_position == _permutation.size()) {
+        reset();
+    }
+}
+
+void block_iterator_global_shuffle::reset()
+{
+    _epoch++;
+    if(_records == nullptr) {
+        if(!open_record_source()) {
+            // the cache is still incomplete, e.g. some blocks failed to write
+            _block_iterator->reset();
+            _blocks_read = 0;
+        }
+        return;
+    }
+    shuffle();
+    _position = 0;
+}
+
+uint32_t block_iterator_global_shuffle::seek(uint32_t epoch, uint32_t record)
+{
+    _epoch = epoch + 1;
+    if(_records == nullptr && !open_record_source()) {
+        // the fallback order of the first epoch is replayed by the block iterator
+        affirm(epoch == 0, "global_shuffle can only seek past the first epoch once the cache is complete");
+        uint32_t skip = _block_iterator->seek(0, record);
+        // all blocks before the one read next are full except maybe the last one
+        uint32_t block_size = _loader->block_size();
+        _blocks_read = (record - skip + block_size - 1) / block_size;
+        return skip;
+    }
+    shuffle();
+    affirm(record < _permutation.size(), "seek past the end of the epoch");
+
+    // records are read individually, so the position need not be block aligned
+    _position = record;
+    return 0;
+}
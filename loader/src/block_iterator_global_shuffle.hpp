@@ -0,0 +1,60 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+#include <random>
+#include "block_loader.hpp"
+#include "block_iterator.hpp"
+#include "block_iterator_shuffled.hpp"
+
+namespace nervana
+{
+    class block_iterator_global_shuffle;
+}
+
+// Draws every epoch from a new permutation of all records, so that records of
+// one macrobatch no longer stay together.  Each read returns the next
+// block_size records of the permutation, read individually from the cache
+// through the loader's record_source.
+//
+// Until the cache is complete there is no record_source and the iterator
+// falls back to block_iterator_shuffled, which also fills the cache; the
+// switch happens at the next epoch boundary.
+//
+// The permutation of each epoch depends only on the seed and the epoch number
+// so that seek() does not have to replay earlier epochs.  Seeking past the
+// first epoch needs a complete cache.
+class nervana::block_iterator_global_shuffle : public block_iterator
+{
+public:
+    block_iterator_global_shuffle(std::shared_ptr<block_loader> loader);
+    void read(nervana::buffer_in_array& dest) override;
+    void reset() override;
+    uint32_t seek(uint32_t epoch, uint32_t record) override;
+
+protected:
+    void shuffle();
+
+private:
+    bool open_record_source();
+
+    std::shared_ptr<block_loader> _loader;
+    std::shared_ptr<record_source> _records;
+    std::shared_ptr<block_iterator_shuffled> _block_iterator;
+    uint32_t _blocks_read;
+    std::vector<uint64_t> _permutation;
+    size_t _position;
+    uint32_t _epoch;
+};
@@ -13,6 +13,8 @@
  limitations under the License.
 */
 
+#include <algorithm>
+
 #include "block_iterator_sequential.hpp"
 
 using namespace std;
@@ -23,7 +25,7 @@ block_iterator_sequential::block_iterator_sequential(shared_ptr<block_loader> lo
     _count(_loader->block_count()),
     _i(0)
 {
-    _loader->prefetch_block(_i);
+    prefetch();
 }
 
 void block_iterator_sequential::read(nervana::buffer_in_array& dest)
@@ -38,10 +40,27 @@ void block_iterator_sequential::read(nervana::buffer_in_array& dest)
     }
 
     _loader->load_block(dest, i);
-    _loader->prefetch_block(_i);
+    prefetch();
 }
 
 void block_iterator_sequential::reset()
 {
     _i = 0;
 }
+
+uint32_t block_iterator_sequential::seek(uint32_t epoch, uint32_t record)
+{
+    // every epoch reads the blocks in the same order
+    _i = record / _loader->block_size();
+    prefetch();
+    return record % _loader->block_size();
+}
+
+void block_iterator_sequential::prefetch()
+{
+    // the blocks after the next one as well if the loader can use them
+    uint32_t depth = min(_loader->prefetch_depth(), _count);
+    for(uint32_t i=0; i<depth; i++) {
+        _loader->prefetch_block((_i + i) % _count);
+    }
+}
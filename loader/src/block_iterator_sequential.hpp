@@ -29,8 +29,11 @@ public:
     block_iterator_sequential(std::shared_ptr<block_loader> loader);
     void read(nervana::buffer_in_array& dest) override;
     void reset() override;
+    uint32_t seek(uint32_t epoch, uint32_t record) override;
 
 private:
+    void prefetch();
+
     std::shared_ptr<block_loader> _loader;
     uint32_t _count;
     uint32_t _i;
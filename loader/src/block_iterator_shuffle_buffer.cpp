@@ -0,0 +1,178 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "util.hpp"
+#include "block_iterator_shuffle_buffer.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_iterator_shuffle_buffer::block_iterator_shuffle_buffer(shared_ptr<block_iterator> source,
+                                                             shared_ptr<block_loader> loader,
+                                                             uint32_t open_blocks,
+                                                             uint32_t buffer_size) :
+    _rand(get_global_random_seed()),
+    _source(source),
+    _loader(loader),
+    _open_block_count(open_blocks),
+    _buffer_size(buffer_size),
+    _blocks_read(0),
+    _memory_usage(0),
+    _epoch(0),
+    _skip_reads(0)
+{
+    affirm(_open_block_count > 0, "shuffle buffer needs at least one open block");
+    affirm(_buffer_size > 0, "shuffle buffer size must be greater than 0");
+}
+
+void block_iterator_shuffle_buffer::read(nervana::buffer_in_array& dest)
+{
+    // reads before the position that seek() asked for
+    for(; _skip_reads > 0; _skip_reads--) {
+        buffer_in_array skipped(dest.size());
+        read_records(skipped);
+    }
+    read_records(dest);
+}
+
+void block_iterator_shuffle_buffer::read_records(nervana::buffer_in_array& dest)
+{
+    size_t elements = dest.size();
+    for(uint32_t i=0; i<_loader->block_size(); i++) {
+        if(!fill_reservoir(elements)) {
+            break;
+        }
+        uniform_int_distribution<size_t> pick(0, _reservoir.size() - 1);
+        record r = take(_reservoir, pick(_rand));
+        for(size_t e=0; e<elements; e++) {
+            if(r[e].error) {
+                dest[e]->add_exception(r[e].error);
+            } else {
+                dest[e]->add_item(r[e].data);
+            }
+        }
+    }
+
+    if(_reservoir.empty() && _open_blocks.empty() && _blocks_read == _loader->block_count()) {
+        // end of the epoch, the source has already wrapped around
+        start_epoch(_epoch + 1);
+    }
+}
+
+void block_iterator_shuffle_buffer::reset()
+{
+    _source->reset();
+    start_epoch(0);
+    _skip_reads = 0;
+}
+
+uint32_t block_iterator_shuffle_buffer::seek(uint32_t epoch, uint32_t record)
+{
+    _source->seek(epoch, 0);
+    start_epoch(epoch);
+    _skip_reads = record / _loader->block_size();
+    return record % _loader->block_size();
+}
+
+void block_iterator_shuffle_buffer::start_epoch(uint32_t epoch)
+{
+    _open_blocks.clear();
+    _reservoir.clear();
+    _blocks_read = 0;
+    _memory_usage = 0;
+    _epoch = epoch;
+    _rand.seed(get_global_random_seed() + _epoch);
+}
+
+bool block_iterator_shuffle_buffer::fill_reservoir(size_t elements)
+{
+    while(_reservoir.size() < _buffer_size) {
+        bool more_blocks = true;
+        while(_open_blocks.size() < _open_block_count && more_blocks) {
+            more_blocks = open_block(elements);
+        }
+        if(_open_blocks.empty()) {
+            break;
+        }
+
+        // pick a record uniformly from all records of the open blocks
+        size_t open_records = 0;
+        for(auto& block : _open_blocks) {
+            open_records += block.size();
+        }
+        size_t index = uniform_int_distribution<size_t>(0, open_records - 1)(_rand);
+        size_t block = 0;
+        while(index >= _open_blocks[block].size()) {
+            index -= _open_blocks[block].size();
+            block++;
+        }
+
+        _reservoir.push_back(take(_open_blocks[block], index));
+        _memory_usage += record_size(_reservoir.back());
+        if(_open_blocks[block].empty()) {
+            _open_blocks.erase(_open_blocks.begin() + block);
+        }
+    }
+    return !_reservoir.empty();
+}
+
+bool block_iterator_shuffle_buffer::open_block(size_t elements)
+{
+    if(_blocks_read == _loader->block_count()) {
+        return false;
+    }
+    buffer_in_array block(elements);
+    _source->read(block);
+    _blocks_read++;
+
+    vector<record> records(block[0]->get_item_count());
+    for(size_t i=0; i<records.size(); i++) {
+        records[i].resize(elements);
+        for(size_t e=0; e<elements; e++) {
+            try {
+                records[i][e].data = block[e]->get_shared_item(i);
+            } catch(std::exception&) {
+                records[i][e].error = current_exception();
+            }
+        }
+        _memory_usage += record_size(records[i]);
+    }
+    if(!records.empty()) {
+        _open_blocks.push_back(move(records));
+    }
+    return true;
+}
+
+block_iterator_shuffle_buffer::record block_iterator_shuffle_buffer::take(vector<record>& records, size_t index)
+{
+    record r = move(records[index]);
+    if(index != records.size() - 1) {
+        records[index] = move(records.back());
+    }
+    records.pop_back();
+    _memory_usage -= record_size(r);
+    return r;
+}
+
+size_t block_iterator_shuffle_buffer::record_size(const record& r)
+{
+    size_t rc = 0;
+    for(const record_item& item : r) {
+        if(item.data) {
+            rc += item.data->size();
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,90 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include "block_loader.hpp"
+#include "block_iterator.hpp"
+
+namespace nervana
+{
+    class block_iterator_shuffle_buffer;
+}
+
+/* block_iterator_shuffle_buffer
+ *
+ * Mixes records across blocks while still reading every block once per epoch,
+ * in whatever order `source` returns them.  Up to `open_blocks` blocks are held
+ * open at a time and records are drawn from them at random into a reservoir of
+ * `buffer_size` records; each output record is a random pick from the
+ * reservoir.  A block is replaced by the next one from `source` as soon as all
+ * of its records have been drawn.
+ *
+ * Every read returns up to block_size records and each epoch returns every
+ * record exactly once, so the last read of an epoch may be short.  Items are
+ * shared with the blocks they were read from, not copied; the records held
+ * cost memory_usage() bytes, at most open_blocks macrobatches plus the
+ * reservoir.
+ *
+ * The draws are seeded per epoch.  seek() positions the source at the start
+ * of the epoch and replays the reads that precede `record` on the next read;
+ * that costs reading the blocks again but nothing downstream of the loader.
+ */
+class nervana::block_iterator_shuffle_buffer : public block_iterator
+{
+public:
+    block_iterator_shuffle_buffer(std::shared_ptr<block_iterator> source,
+                                  std::shared_ptr<block_loader> loader,
+                                  uint32_t open_blocks,
+                                  uint32_t buffer_size);
+    void read(nervana::buffer_in_array& dest) override;
+    void reset() override;
+    uint32_t seek(uint32_t epoch, uint32_t record) override;
+
+    size_t memory_usage() const { return _memory_usage; }
+
+private:
+    struct record_item
+    {
+        std::shared_ptr<std::vector<char>>  data;
+        std::exception_ptr                  error;
+    };
+
+    // one item per buffer_in of the block
+    typedef std::vector<record_item> record;
+
+    void read_records(nervana::buffer_in_array& dest);
+    void start_epoch(uint32_t epoch);
+    bool fill_reservoir(size_t elements);
+    bool open_block(size_t elements);
+    record take(std::vector<record>& records, size_t index);
+    size_t record_size(const record& r);
+
+    std::minstd_rand0 _rand;
+    std::shared_ptr<block_iterator> _source;
+    std::shared_ptr<block_loader> _loader;
+    const uint32_t _open_block_count;
+    const uint32_t _buffer_size;
+
+    std::vector<std::vector<record>> _open_blocks;
+    std::vector<record> _reservoir;
+    uint32_t _blocks_read;
+    size_t _memory_usage;
+    uint32_t _epoch;
+    uint32_t _skip_reads;
+};
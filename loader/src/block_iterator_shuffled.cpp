@@ -35,7 +35,7 @@ block_iterator_shuffled::block_iterator_shuffled(shared_ptr<block_loader> loader
     iota(_indices.begin(), _indices.end(), 0);
     shuffle();
     _it = _indices.begin();
-    _loader->prefetch_block(*_it);
+    prefetch();
 }
 
 void block_iterator_shuffled::shuffle()
@@ -60,7 +60,7 @@ void block_iterator_shuffled::read(nervana::buffer_in_array &dest)
     if(++_it == _indices.end()) {
         reset();
     }
-    _loader->prefetch_block(*_it);
+    prefetch();
 }
 
 void block_iterator_shuffled::reset()
@@ -69,3 +69,40 @@ void block_iterator_shuffled::reset()
     _it = _indices.begin();
     ++_epoch;
 }
+
+uint32_t block_iterator_shuffled::seek(uint32_t epoch, uint32_t record)
+{
+    // replay the block order shuffles from construction on, they are cheap
+    // compared to reading the blocks
+    _rand.seed(get_global_random_seed());
+    iota(_indices.begin(), _indices.end(), 0);
+    shuffle();
+    _epoch = 0;
+    for(uint32_t i=0; i<=epoch; i++) {
+        reset();
+    }
+
+    // only the block with the highest number may be short
+    const uint32_t block_size   = _loader->block_size();
+    const uint32_t object_count = _loader->object_count();
+    for(_it = _indices.begin(); _it != _indices.end(); ++_it) {
+        uint32_t count = min(block_size, object_count - *_it * block_size);
+        if(record < count) {
+            break;
+        }
+        record -= count;
+    }
+    affirm(_it != _indices.end(), "seek past the end of the epoch");
+    prefetch();
+    return record;
+}
+
+void block_iterator_shuffled::prefetch()
+{
+    // the blocks after the next one as well if the loader can use them, as
+    // far as the order of this epoch is known
+    uint32_t depth = _loader->prefetch_depth();
+    for(auto it = _it; it != _indices.end() && depth > 0; ++it, --depth) {
+        _loader->prefetch_block(*it);
+    }
+}
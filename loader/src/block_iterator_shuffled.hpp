@@ -31,9 +31,11 @@ public:
     block_iterator_shuffled(std::shared_ptr<block_loader> loader);
     void read(nervana::buffer_in_array& dest) override;
     void reset() override;
+    uint32_t seek(uint32_t epoch, uint32_t record) override;
 
 protected:
     void shuffle();
+    void prefetch();
 
 private:
     std::minstd_rand0 _rand;
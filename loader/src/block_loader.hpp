@@ -15,7 +15,9 @@
 
 #pragma once
 #include <random>
+#include <memory>
 #include "buffer_in.hpp"
+#include "record_source.hpp"
 
 /*
  * A block_loader is something which can load blocks of data into a buffer_in_array
@@ -31,8 +33,15 @@ class nervana::block_loader
 public:
     virtual void load_block(nervana::buffer_in_array& dest, uint32_t block_num) = 0;
     virtual void prefetch_block(uint32_t block_num);
+    // number of blocks worth prefetching ahead of the one read next.  Only
+    // loaders that fetch several blocks at once go beyond 1.
+    virtual uint32_t prefetch_depth() { return 1; }
     virtual uint32_t object_count() = 0;
 
+    // loaders which can read individual records (complete caches) return a
+    // record_source for them, others return nullptr
+    virtual std::shared_ptr<record_source> get_record_source() { return nullptr; }
+
     uint32_t block_count();
     uint32_t block_size();
 
@@ -20,6 +20,7 @@
 
 #include "cpio.hpp"
 #include "block_loader_cpio_cache.hpp"
+#include "cpio_record_index.hpp"
 #include "file_util.hpp"
 
 using namespace std;
@@ -28,14 +29,23 @@ using namespace nervana;
 block_loader_cpio_cache::block_loader_cpio_cache(const string& rootCacheDir,
                                                  const string& cache_id,
                                                  const string& version,
-                                                 shared_ptr<block_loader> loader) :
+                                                 shared_ptr<block_loader> loader,
+                                                 size_t cache_max_bytes) :
     block_loader(loader->block_size()),
     _loader(loader),
     block_count{loader->block_count()},
-    cache_owner{false}
+    cache_owner{false},
+    ownership_lock{-1}
 {
     invalidate_old_cache(rootCacheDir, cache_id, version);
 
+    if(cache_max_bytes > 0) {
+        // make room before creating our own directory.  If every block of
+        // this cache was evicted its directory is gone too and it is rebuilt
+        // from scratch below.
+        _eviction = make_shared<cache_eviction>(rootCacheDir, cache_max_bytes);
+    }
+
     _cacheDir = file_util::path_join(rootCacheDir, cache_id + "_" + version);
 
     if(file_util::make_directory(_cacheDir))
@@ -97,6 +107,10 @@ bool block_loader_cpio_cache::load_block_from_cache(buffer_in_array& dest, uint3
 
     reader.close();
 
+    if(_eviction) {
+        _eviction->block_accessed(block_filename(block_num));
+    }
+
     // cpio file was read successfully, no need to hit primary data
     // source
     return true;
@@ -104,10 +118,19 @@ bool block_loader_cpio_cache::load_block_from_cache(buffer_in_array& dest, uint3
 
 void block_loader_cpio_cache::write_block_to_cache(buffer_in_array& buff, uint32_t block_num)
 {
+    if(_eviction) {
+        // the whole directory may have been evicted while we were using it
+        file_util::make_directory(_cacheDir);
+    }
+
     cpio::file_writer writer;
     writer.open(block_filename(block_num));
     writer.write_all_records(buff);
     writer.close();
+
+    if(_eviction) {
+        _eviction->block_written(block_filename(block_num));
+    }
 }
 
 void block_loader_cpio_cache::invalidate_old_cache(const string& rootCacheDir,
@@ -162,6 +185,26 @@ uint32_t block_loader_cpio_cache::object_count()
     return _loader->object_count();
 }
 
+shared_ptr<record_source> block_loader_cpio_cache::get_record_source()
+{
+    if(_eviction || check_if_complete() == false) {
+        return nullptr;
+    }
+    if(_record_index == nullptr) {
+        // the cache is marked complete when the last block is written, which
+        // in shuffled order is not the last block to be written
+        vector<string> files;
+        for(uint32_t block_num=0; block_num<block_count; block_num++) {
+            files.push_back(block_filename(block_num));
+            if(!file_util::exists(files.back())) {
+                return nullptr;
+            }
+        }
+        _record_index = make_shared<cpio_record_index>(files);
+    }
+    return _record_index;
+}
+
 bool block_loader_cpio_cache::check_if_complete()
 {
     string file = file_util::path_join(_cacheDir, cache_complete_filename);
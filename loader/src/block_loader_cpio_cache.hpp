@@ -18,6 +18,7 @@
 #include <string>
 
 #include "block_loader_file.hpp"
+#include "cache_eviction.hpp"
 
 /* block_loader_cpio_cache
  *
@@ -28,6 +29,11 @@
  * is used to help invalidate old versions of the same dataset.  If a cache is
  * created with the same cache_id as an existing cache, but a different version,
  * old version is deleted.
+ *
+ * If `cache_max_bytes` is non-zero, the total size of all caches under
+ * `rootCacheDir` is kept below it by evicting least recently used blocks (see
+ * cache_eviction).  Blocks missing from the cache are reloaded from `loader`
+ * and written back, so a partially evicted cache keeps working.
  */
 
 namespace nervana
@@ -40,30 +46,45 @@ class nervana::block_loader_cpio_cache : public block_loader
 public:
     block_loader_cpio_cache(const std::string& rootCacheDir,
                             const std::string& cache_id, const std::string& version,
-                            std::shared_ptr<block_loader> loader);
+                            std::shared_ptr<block_loader> loader,
+                            size_t cache_max_bytes = 0);
 
     void load_block(nervana::buffer_in_array& dest, uint32_t block_num) override;
     void prefetch_block(uint32_t block_num) override;
+    uint32_t prefetch_depth() override { return _loader->prefetch_depth(); }
     uint32_t object_count() override;
 
+    // once the cache is complete its records can be read individually, unless
+    // blocks may be evicted (cache_max_bytes)
+    std::shared_ptr<record_source> get_record_source() override;
+
+    // used by tools which fill the cache out of band (aeon-cache-build).  Blocks
+    // may be written in any order and from several threads; the writer is
+    // responsible for marking the cache complete once every block is written.
+    void write_block_to_cache(nervana::buffer_in_array& dest, uint32_t block_num);
+    bool check_if_complete();
+    void mark_cache_complete();
+    void release_ownership();
+
+    // remove caches of other versions of the dataset, also used by
+    // block_loader_packed_cache
+    static void invalidate_old_cache(const std::string& rootCacheDir, const std::string& cache_id, const std::string& version);
+
 private:
     bool load_block_from_cache(nervana::buffer_in_array& dest, uint32_t block_num);
-    void write_block_to_cache(nervana::buffer_in_array& dest, uint32_t block_num);
     std::string block_filename(uint32_t block_num);
 
-    void invalidate_old_cache(const std::string& rootCacheDir, const std::string& cache_id, const std::string& version);
-    bool filename_holds_invalid_cache(const std::string& filename, const std::string& cache_id, const std::string& version);
+    static bool filename_holds_invalid_cache(const std::string& filename, const std::string& cache_id, const std::string& version);
 
-    bool check_if_complete();
-    void mark_cache_complete();
     bool take_ownership();
-    void release_ownership();
 
     const std::string owner_lock_filename = "caching_in_progress";
     const std::string cache_complete_filename = "cache_complete";
 
     std::string                     _cacheDir;
     std::shared_ptr<block_loader>   _loader;
+    std::shared_ptr<cache_eviction> _eviction;
+    std::shared_ptr<record_source>  _record_index;
     const size_t                    block_count;
     bool                            cache_owner;
     int                             ownership_lock;
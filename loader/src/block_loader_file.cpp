@@ -27,9 +27,12 @@ using namespace nervana;
 
 block_loader_file::block_loader_file(shared_ptr<nervana::manifest_csv> mfst,
                                      float subset_fraction,
-                                     uint32_t block_size) :
+                                     uint32_t block_size,
+                                     int shard_count,
+                                     int shard_index) :
     block_loader(block_size),
     _manifest(mfst),
+    prefetch_block_num(0),
     prefetch_pending(false)
 {
     elements_per_record = _manifest->nelements();
@@ -37,6 +40,9 @@ block_loader_file::block_loader_file(shared_ptr<nervana::manifest_csv> mfst,
            "subset_fraction must be >= 0 and <= 1");
 
     _manifest->generate_subset(subset_fraction);
+
+    // shard after the subset so that the shards split the same subset
+    _manifest->generate_shard(shard_count, shard_index);
 }
 
 void block_loader_file::load_block(nervana::buffer_in_array& dest, uint32_t block_num)
@@ -47,8 +53,13 @@ void block_loader_file::load_block(nervana::buffer_in_array& dest, uint32_t bloc
 //        else
 //            cout << __FILE__ << " " << __LINE__ << " prefetch busy" << endl;
         async_handler.wait();
-    } else {
+        prefetch_pending = false;
+    }
+    if(prefetch_block_num != block_num || prefetch_buffer.empty()) {
+        // nothing prefetched for this block, e.g. a cache in front of us
+        // found the block on disk when prefetching but it was evicted since
         fetch_block(block_num);
+        prefetch_block_num = block_num;
     }
     auto it = prefetch_buffer.begin();
     for(int i=0; i<block_size(); i++)
@@ -66,6 +77,7 @@ void block_loader_file::load_block(nervana::buffer_in_array& dest, uint32_t bloc
             }
         }
     }
+    prefetch_buffer.clear();
 }
 
 void block_loader_file::fetch_block(uint32_t block_num)
@@ -78,12 +90,9 @@ void block_loader_file::fetch_block(uint32_t block_num)
 
     // begin_i and end_i contain the indexes into the manifest file which
     // hold the requested block
-    size_t begin_i = block_num * _block_size;
-    size_t end_i = min((block_num + 1) * (size_t)_block_size, _manifest->objectCount());
-
-    // ensure we stay within bounds of manifest
-    affirm(begin_i <= _manifest->objectCount(), "block_loader_file begin outside manifest bounds");
-    affirm(end_i <= _manifest->objectCount(), "block_loader_file end outside manifest bounds");
+    size_t begin_i;
+    size_t end_i;
+    block_range(block_num, begin_i, end_i);
 
     // TODO: move index offset logic and bounds asserts into Manifest
     // interface to more easily support things like offset/limit queries.
@@ -116,6 +125,39 @@ void block_loader_file::fetch_block(uint32_t block_num)
     }
 }
 
+void block_loader_file::read_block(nervana::buffer_in_array& dest, uint32_t block_num)
+{
+    // read block_num straight into dest, bypassing the prefetch buffer.  Unlike
+    // load_block this keeps no state in the block_loader_file so several threads
+    // may read different blocks at the same time.
+    size_t begin_i;
+    size_t end_i;
+    block_range(block_num, begin_i, end_i);
+
+    for(auto it = _manifest->begin() + begin_i; it != _manifest->begin() + end_i; ++it) {
+        auto file_list = *it;
+        for (uint32_t i = 0; i < file_list.size(); i++) {
+            try {
+                vector<char> buffer;
+                load_file(buffer, file_list[i]);
+                dest[i]->add_item(move(buffer));
+            } catch (std::exception& e) {
+                dest[i]->add_exception(current_exception());
+            }
+        }
+    }
+}
+
+void block_loader_file::block_range(uint32_t block_num, size_t& begin_i, size_t& end_i)
+{
+    begin_i = block_num * (size_t)_block_size;
+    end_i = min((block_num + 1) * (size_t)_block_size, _manifest->objectCount());
+
+    // ensure we stay within bounds of manifest
+    affirm(begin_i <= _manifest->objectCount(), "block_loader_file begin outside manifest bounds");
+    affirm(end_i <= _manifest->objectCount(), "block_loader_file end outside manifest bounds");
+}
+
 void block_loader_file::load_file(vector<char>& buffer, const string& filename)
 {
     off_t size = file_util::get_file_size(filename);
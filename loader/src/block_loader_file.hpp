@@ -36,9 +36,12 @@ class nervana::block_loader_file : public block_loader
 public:
     block_loader_file(std::shared_ptr<nervana::manifest_csv> manifest,
                       float subset_fraction,
-                      uint32_t block_size);
+                      uint32_t block_size,
+                      int shard_count=1,
+                      int shard_index=0);
 
     void load_block(nervana::buffer_in_array& dest, uint32_t block_num) override;
+    void read_block(nervana::buffer_in_array& dest, uint32_t block_num);
     void load_file(std::vector<char>& buff, const std::string& filename);
     void prefetch_block(uint32_t block_num) override;
     uint32_t object_count() override;
@@ -47,6 +50,7 @@ private:
     void generate_subset(const std::shared_ptr<nervana::manifest_csv>& manifest, float subset_fraction);
     void prefetch_entry(void* param);
     void fetch_block(uint32_t block_num);
+    void block_range(uint32_t block_num, size_t& begin_i, size_t& end_i);
 
     const std::shared_ptr<nervana::manifest_csv> _manifest;
     async                                        async_handler;
@@ -0,0 +1,107 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "block_loader_memory_cache.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_loader_memory_cache::block_loader_memory_cache(shared_ptr<block_loader> loader, size_t max_bytes) :
+    block_loader(loader->block_size()),
+    _loader(loader),
+    _max_bytes(max_bytes),
+    _size_bytes(0)
+{
+}
+
+void block_loader_memory_cache::load_block(buffer_in_array& dest, uint32_t block_num)
+{
+    if(load_block_from_cache(dest, block_num)) {
+        return;
+    }
+
+    _loader->load_block(dest, block_num);
+    add_block_to_cache(dest, block_num);
+}
+
+void block_loader_memory_cache::prefetch_block(uint32_t block_num)
+{
+    lock_guard<mutex> lock(_mutex);
+    if(_blocks.find(block_num) == _blocks.end()) {
+        _loader->prefetch_block(block_num);
+    }
+}
+
+uint32_t block_loader_memory_cache::object_count()
+{
+    return _loader->object_count();
+}
+
+size_t block_loader_memory_cache::size_bytes()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _size_bytes;
+}
+
+size_t block_loader_memory_cache::cached_block_count()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _blocks.size();
+}
+
+bool block_loader_memory_cache::load_block_from_cache(buffer_in_array& dest, uint32_t block_num)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = _blocks.find(block_num);
+    if(it == _blocks.end()) {
+        return false;
+    }
+
+    const cached_block& block = it->second;
+    for(size_t i=0; i<block.size(); i++) {
+        for(const cached_item& item : block[i]) {
+            if(item.error) {
+                dest[i]->add_exception(item.error);
+            } else {
+                dest[i]->add_item(item.data);
+            }
+        }
+    }
+    return true;
+}
+
+void block_loader_memory_cache::add_block_to_cache(buffer_in_array& src, uint32_t block_num)
+{
+    cached_block block(src.size());
+    size_t bytes = 0;
+    for(size_t i=0; i<src.size(); i++) {
+        int count = src[i]->get_item_count();
+        block[i].resize(count);
+        for(int j=0; j<count; j++) {
+            try {
+                block[i][j].data = src[i]->get_shared_item(j);
+                bytes += block[i][j].data->size();
+            } catch(std::exception&) {
+                block[i][j].error = current_exception();
+            }
+        }
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    if(_size_bytes + bytes <= _max_bytes && _blocks.find(block_num) == _blocks.end()) {
+        _blocks[block_num] = move(block);
+        _size_bytes += bytes;
+    }
+}
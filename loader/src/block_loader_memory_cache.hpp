@@ -0,0 +1,74 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "block_loader.hpp"
+
+/* block_loader_memory_cache
+ *
+ * keeps the encoded blocks returned by `loader` in memory so that later epochs
+ * don't go back to the disk cache or the source files.  Cached items are handed
+ * out as shared buffers (see buffer_in::add_item) so a hit copies no data.
+ *
+ * At most `max_bytes` of item data is held.  Blocks are read in a cycle, once
+ * per epoch, so evicting the least recently used block would evict exactly the
+ * block needed next once the dataset is larger than the cache.  Instead blocks
+ * are admitted until the cache is full and then kept, which serves
+ * max_bytes/dataset size of every epoch from memory.
+ */
+
+namespace nervana
+{
+    class block_loader_memory_cache;
+}
+
+class nervana::block_loader_memory_cache : public block_loader
+{
+public:
+    block_loader_memory_cache(std::shared_ptr<block_loader> loader, size_t max_bytes);
+
+    void load_block(nervana::buffer_in_array& dest, uint32_t block_num) override;
+    void prefetch_block(uint32_t block_num) override;
+    uint32_t prefetch_depth() override { return _loader->prefetch_depth(); }
+    uint32_t object_count() override;
+    std::shared_ptr<record_source> get_record_source() override { return _loader->get_record_source(); }
+
+    size_t size_bytes();
+    size_t cached_block_count();
+
+private:
+    struct cached_item
+    {
+        std::shared_ptr<std::vector<char>>  data;
+        std::exception_ptr                  error;
+    };
+
+    // one vector of items per buffer_in of the block
+    typedef std::vector<std::vector<cached_item>> cached_block;
+
+    bool load_block_from_cache(nervana::buffer_in_array& dest, uint32_t block_num);
+    void add_block_to_cache(nervana::buffer_in_array& src, uint32_t block_num);
+
+    std::shared_ptr<block_loader>       _loader;
+    const size_t                        _max_bytes;
+    size_t                              _size_bytes;
+    std::map<uint32_t, cached_block>    _blocks;
+    std::mutex                          _mutex;
+};
@@ -20,6 +20,8 @@
 #include <curl/easy.h>
 #include <curl/curlbuild.h>
 
+#include <algorithm>
+
 #include "json.hpp"
 #include "block_loader_nds.hpp"
 #include "interface.hpp"
@@ -28,13 +30,41 @@
 using namespace std;
 using namespace nervana;
 
-size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream)
+namespace
 {
-    // callback used by curl.  writes data from ptr into the
-    // stringstream passed in to `stream`.
+    bool is_transient(CURLcode res, long http_code)
+    {
+        switch(res) {
+        case CURLE_OK:
+            // a response that ended early
+            return true;
+        case CURLE_HTTP_RETURNED_ERROR:
+            return http_code == 429 || http_code >= 500;
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
 
-    string data((const char*) ptr, (size_t) size * nmemb);
-    *((stringstream*) stream) << data;
+size_t block_loader_nds::write_data(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    // callback used by curl.  hands the data in ptr on to the sink of the
+    // transfer.  exceptions must not unwind through curl, so they abort the
+    // transfer and are rethrown once curl returns.
+    transfer* body = (transfer*)userdata;
+    try {
+        body->sink((const char*)ptr, size * nmemb);
+    } catch(...) {
+        body->error = current_exception();
+        return 0;
+    }
     return size * nmemb;
 }
 
@@ -44,7 +74,9 @@ block_loader_nds::block_loader_nds(
         int collection_id,
         uint32_t block_size,
         int shard_count,
-        int shard_index
+        int shard_index,
+        uint32_t concurrency,
+        uint32_t retries
         ):
     block_loader(block_size),
     _baseurl(baseurl),
@@ -52,82 +84,308 @@ block_loader_nds::block_loader_nds(
     _collection_id(collection_id),
     _shard_count(shard_count),
     _shard_index(shard_index),
-    m_elements_per_record(0)
+    _concurrency(concurrency),
+    _retries(retries),
+    _jitter(random_device{}())
 {
     affirm(shard_index < shard_count, "shard index must be less then shard count");
+    affirm(concurrency > 0, "nds concurrency must be greater than 0");
 
     load_metadata();
+    _thread = thread(&block_loader_nds::fetch_thread, this);
 }
 
 block_loader_nds::~block_loader_nds()
 {
-    if(prefetch_pending) {
-        async_handler.wait();
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _request_added.notify_one();
+    _thread.join();
+
+    for(void* curl : _idle_handles) {
+        curl_easy_cleanup(curl);
     }
 }
 
 void block_loader_nds::load_block(nervana::buffer_in_array& dest, uint32_t block_num)
 {
-    m_elements_per_record = dest.size();
-    if(prefetch_pending) {
-        async_handler.wait();
-    } else {
-        fetch_block(block_num);
-    }
-    auto it = prefetch_buffer.begin();
-    for(int i=0; i<block_size(); i++)
+    shared_ptr<request> r;
     {
-        if(it != prefetch_buffer.end())
-        {
-            for(int j=0; j<dest.size(); j++)
-            {
-                dest[j]->add_item(move(*it++));
+        unique_lock<mutex> lock(_mutex);
+        add_request(block_num);
+        r = _requests[block_num];
+        _request_done.wait(lock, [&r]() { return r->done; });
+        _requests.erase(block_num);
+    }
+    if(r->error) {
+        rethrow_exception(r->error);
+    }
+
+    // elements come record by record
+    if(r->elements.size() % dest.size() != 0) {
+        throw std::runtime_error("macrobatch " + to_string(block_num) + " from nds has " +
+                                 to_string(r->elements.size()) + " elements, not a multiple of " +
+                                 to_string(dest.size()));
+    }
+    for(size_t i=0; i<r->elements.size(); i++) {
+        dest[i % dest.size()]->add_item(move(r->elements[i]));
+    }
+}
+
+void block_loader_nds::prefetch_block(uint32_t block_num)
+{
+    lock_guard<mutex> lock(_mutex);
+    add_request(block_num);
+}
+
+void block_loader_nds::add_request(uint32_t block_num)
+{
+    // called with _mutex held
+    if(_requests.find(block_num) != _requests.end()) {
+        return;
+    }
+    auto r = make_shared<request>();
+    r->block_num = block_num;
+    r->sequence = _sequence++;
+    _requests[block_num] = r;
+
+    // blocks prefetched but never loaded, e.g. after a seek, are dropped
+    // oldest first.  Transfers in flight are left to finish.
+    while(_requests.size() > 2 * _concurrency) {
+        auto oldest = _requests.end();
+        for(auto it = _requests.begin(); it != _requests.end(); ++it) {
+            if(!it->second->active && it->second != r &&
+               (oldest == _requests.end() || it->second->sequence < oldest->second->sequence)) {
+                oldest = it;
             }
         }
+        if(oldest == _requests.end()) {
+            break;
+        }
+        _requests.erase(oldest);
     }
-    prefetch_buffer.clear();
+    _request_added.notify_one();
 }
 
-void block_loader_nds::fetch_block(uint32_t block_num)
+void block_loader_nds::fetch_thread()
 {
-    // not much use in mutlithreading here since in most cases, our next step is
-    // to shuffle the entire BufferPair, which requires the entire buffer loaded.
+    CURLM* multi = curl_multi_init();
+    unique_lock<mutex> lock(_mutex);
+    while(!_stop) {
+        start_requests(multi);
+
+        if(_active == 0) {
+            // sleep until a block is requested or the next retry is due
+            auto retry_time = chrono::steady_clock::time_point::max();
+            for(auto& it : _requests) {
+                if(!it.second->done) {
+                    retry_time = min(retry_time, it.second->retry_time);
+                }
+            }
+            if(retry_time == chrono::steady_clock::time_point::max()) {
+                _request_added.wait(lock);
+            } else {
+                _request_added.wait_until(lock, retry_time);
+            }
+            continue;
+        }
+
+        // transfers run without the lock, the write callbacks only touch
+        // their own active request which nobody else does
+        lock.unlock();
+        int running;
+        curl_multi_perform(multi, &running);
+        // new requests are picked up at least this often
+        curl_multi_wait(multi, nullptr, 0, 50, nullptr);
+        curl_multi_perform(multi, &running);
+
+        vector<pair<CURL*, CURLcode>> finished;
+        int queued;
+        CURLMsg* msg;
+        while((msg = curl_multi_info_read(multi, &queued)) != nullptr) {
+            if(msg->msg == CURLMSG_DONE) {
+                finished.emplace_back(msg->easy_handle, msg->data.result);
+            }
+        }
+        lock.lock();
 
-    // get data from url and write it into cpio_stream
-    stringstream cpio_stream;
-    get(load_block_url(block_num), cpio_stream);
+        for(auto& f : finished) {
+            finish_request(multi, f.first, f.second);
+        }
+    }
 
-    // parse cpio_stream into dest one record (consisting of multiple elements) at a time
-    nervana::cpio::reader reader(&cpio_stream);
-    for(int i=0; i < reader.itemCount() * m_elements_per_record; ++i) {
-        vector<char> buffer;
-        reader.read(buffer);
-        prefetch_buffer.push_back(move(buffer));
+    // abandon transfers still in flight
+    for(auto& it : _requests) {
+        request* r = it.second.get();
+        if(r->active) {
+            curl_multi_remove_handle(multi, r->curl);
+            curl_easy_cleanup(r->curl);
+            r->curl = nullptr;
+            r->active = false;
+        }
     }
+    lock.unlock();
+    curl_multi_cleanup(multi);
 }
 
-void block_loader_nds::get(const string& url, stringstream &stream)
+void block_loader_nds::start_requests(void* multi)
+{
+    // called with _mutex held, oldest requests first
+    auto now = chrono::steady_clock::now();
+    vector<request*> ready;
+    for(auto& it : _requests) {
+        request* r = it.second.get();
+        if(!r->active && !r->done && r->retry_time <= now) {
+            ready.push_back(r);
+        }
+    }
+    sort(ready.begin(), ready.end(), [](request* a, request* b) { return a->sequence < b->sequence; });
+
+    for(request* r : ready) {
+        if(_active == _concurrency) {
+            break;
+        }
+        r->active = true;
+        r->attempts++;
+        _active++;
+
+        r->elements.clear();
+        r->reader = make_shared<cpio::stream_reader>([r](vector<char>&& element) {
+            r->elements.push_back(move(element));
+        });
+        r->body.error = nullptr;
+        r->body.sink = [r](const char* data, size_t size) {
+            r->reader->write(data, size);
+        };
+
+        r->curl = acquire_handle();
+        setup_handle(r->curl, load_block_url(r->block_num), &r->body);
+        curl_easy_setopt(r->curl, CURLOPT_PRIVATE, r);
+        curl_multi_add_handle(multi, r->curl);
+    }
+}
+
+void block_loader_nds::finish_request(void* multi, void* curl, int result)
+{
+    // called with _mutex held
+    CURLcode res = (CURLcode)result;
+    request* r = nullptr;
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &r);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_multi_remove_handle(multi, curl);
+    release_handle(curl);
+    r->curl = nullptr;
+    r->active = false;
+    _active--;
+
+    if(r->body.error) {
+        // the response is not a valid macrobatch, asking again won't help
+        r->error = r->body.error;
+        r->done = true;
+    } else if(res == CURLE_OK && http_code == 200 && r->reader->complete()) {
+        r->done = true;
+    } else {
+        stringstream ss;
+        ss << "HTTP GET on \n'" << load_block_url(r->block_num) << "' failed. ";
+        ss << "status code: " << http_code;
+        if (res != CURLE_OK) {
+            ss << " curl return: " << curl_easy_strerror(res);
+        } else {
+            ss << " response ended before the end of the macrobatch";
+        }
+        ss << " after " << r->attempts << " attempts";
+
+        if(is_transient(res, http_code) && r->attempts <= _retries) {
+            r->retry_time = chrono::steady_clock::now() + retry_delay(r->attempts);
+        } else {
+            r->error = make_exception_ptr(std::runtime_error(ss.str()));
+            r->done = true;
+        }
+    }
+    if(r->done) {
+        r->reader = nullptr;
+        r->body.sink = nullptr;
+        _request_done.notify_all();
+    }
+}
+
+chrono::milliseconds block_loader_nds::retry_delay(uint32_t attempt)
+{
+    // exponential backoff from 100ms up to 10s.  Half of the delay is random
+    // so that clients failing together don't retry together.
+    uint32_t delay = 100u << min(attempt - 1, 7u);
+    delay = min(delay, 10000u);
+    uniform_int_distribution<uint32_t> jitter(0, delay / 2);
+    return chrono::milliseconds(delay - jitter(_jitter));
+}
+
+void* block_loader_nds::acquire_handle()
 {
-    // reuse curl connection across requests
-    _curl = curl_easy_init();
+    {
+        lock_guard<mutex> lock(_handle_mutex);
+        if(!_idle_handles.empty()) {
+            void* curl = _idle_handles.back();
+            _idle_handles.pop_back();
+            return curl;
+        }
+    }
+    void* curl = curl_easy_init();
+    if(curl == nullptr) {
+        throw std::runtime_error("curl_easy_init failed");
+    }
+    return curl;
+}
 
-    // given a url, make an HTTP GET request and fill stream with
-    // the body of the response
+void block_loader_nds::release_handle(void* curl)
+{
+    lock_guard<mutex> lock(_handle_mutex);
+    _idle_handles.push_back(curl);
+}
 
-    curl_easy_setopt(_curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(_curl, CURLOPT_FOLLOWLOCATION, 1L);
+void block_loader_nds::setup_handle(void* curl, const string& url, transfer* body)
+{
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     // Prevent "longjmp causes uninitialized stack frame" bug
-    curl_easy_setopt(_curl, CURLOPT_NOSIGNAL, 1);
-    curl_easy_setopt(_curl, CURLOPT_ACCEPT_ENCODING, "deflate");
-    curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, write_data);
-    curl_easy_setopt(_curl, CURLOPT_WRITEDATA, &stream);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    // error responses must not reach the sink, e.g. the cpio parser
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "deflate");
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, body);
+}
+
+void block_loader_nds::get(const string& url, stringstream &stream)
+{
+    get(url, [&stream](const char* data, size_t size) {
+        stream.write(data, size);
+    });
+}
+
+void block_loader_nds::get(const string& url, const function<void(const char*, size_t)>& sink)
+{
+    // given a url, make an HTTP GET request and hand the body of the
+    // response to sink.  curl keeps the connection of a handle open, so
+    // reusing handles avoids a new connection per request
+    void* curl = acquire_handle();
+    transfer body{sink, nullptr};
+    setup_handle(curl, url, &body);
 
     // Perform the request, res will get the return code
-    CURLcode res = curl_easy_perform(_curl);
+    CURLcode res = curl_easy_perform(curl);
 
     // Check for errors
     long http_code = 0;
-    curl_easy_getinfo (_curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &http_code);
+    release_handle(curl);
+
+    if(body.error) {
+        rethrow_exception(body.error);
+    }
     if (http_code != 200 || res != CURLE_OK) {
         stringstream ss;
         ss << "HTTP GET on \n'" << url << "' failed. ";
@@ -135,12 +393,8 @@ void block_loader_nds::get(const string& url, stringstream &stream)
         if (res != CURLE_OK) {
             ss << " curl return: " << curl_easy_strerror(res);
         }
-
-        curl_easy_cleanup(_curl);
         throw std::runtime_error(ss.str());
     }
-
-    curl_easy_cleanup(_curl);
 }
 
 const string block_loader_nds::load_block_url(uint32_t block_num)
@@ -199,19 +453,3 @@ uint32_t block_loader_nds::block_count()
 {
     return _blockCount;
 }
-
-void block_loader_nds::prefetch_block(uint32_t block_num)
-{
-    if (m_elements_per_record > 0)
-    {
-        prefetch_pending = true;
-        prefetch_block_num = block_num;
-        std::function<void(void*)> f = std::bind(&block_loader_nds::prefetch_entry, this, &block_num);
-        async_handler.run(f);
-    }
-}
-
-void block_loader_nds::prefetch_entry(void* param)
-{
-    fetch_block(prefetch_block_num);
-}
@@ -17,6 +17,13 @@
 
 #include <sstream>
 #include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <map>
+#include <memory>
+#include <chrono>
 
 #include "buffer_in.hpp"
 #include "cpio.hpp"
@@ -28,6 +35,18 @@ namespace nervana
     class block_loader_nds;
 }
 
+/* block_loader_nds
+ *
+ * Reads macrobatches from the nervana data service.  Prefetched blocks are
+ * fetched by a background thread that keeps up to `concurrency` requests in
+ * flight on one curl multi handle and parses each response as it arrives.
+ * Block iterators prefetch `concurrency` blocks ahead, see prefetch_depth().
+ *
+ * Requests failing with transient errors (connection problems, truncated
+ * responses, 429 and 5xx responses) are retried up to `retries` times after a
+ * randomly jittered, exponentially growing delay.  Other errors are reported
+ * by load_block.
+ */
 class nervana::block_loader_nds : public block_loader
 {
 public:
@@ -37,41 +56,88 @@ public:
             int collection_id,
             uint32_t block_size,
             int shard_count=1,
-            int shard_index=0
+            int shard_index=0,
+            uint32_t concurrency=4,
+            uint32_t retries=3
             );
 
     ~block_loader_nds();
 
     void load_block(nervana::buffer_in_array& dest, uint32_t block_num) override;
     void prefetch_block(uint32_t block_num) override;
+    uint32_t prefetch_depth() override { return _concurrency; }
     uint32_t object_count() override;
 
     uint32_t block_count();
 
 private:
+    // where curl's write callback sends the body of a response
+    struct transfer
+    {
+        std::function<void(const char*, size_t)> sink;
+        std::exception_ptr                  error;
+    };
+
+    struct request
+    {
+        uint32_t                            block_num;
+        uint64_t                            sequence;
+        bool                                active = false;
+        bool                                done = false;
+        uint32_t                            attempts = 0;
+        std::chrono::steady_clock::time_point retry_time;
+        std::vector<std::vector<char>>      elements;
+        std::shared_ptr<cpio::stream_reader> reader;
+        transfer                            body;
+        std::exception_ptr                  error;
+        void*                               curl = nullptr;
+    };
+
+    static size_t write_data(void* ptr, size_t size, size_t nmemb, void* userdata);
+
     void load_metadata();
 
     void get(const std::string& url, std::stringstream& stream);
 
+    // stream the body of the response to `sink` as it arrives
+    void get(const std::string& url, const std::function<void(const char*, size_t)>& sink);
+
+    // idle curl handles keep their connection to the server alive between
+    // requests
+    void* acquire_handle();
+    void release_handle(void* curl);
+    void setup_handle(void* curl, const std::string& url, transfer* body);
+
     const std::string load_block_url(uint32_t block_num);
     const std::string metadata_url();
-    void prefetch_entry(void* param);
-    void fetch_block(uint32_t block_num);
+
+    void fetch_thread();
+    void add_request(uint32_t block_num);
+    void start_requests(void* multi);
+    void finish_request(void* multi, void* curl, int result);
+    std::chrono::milliseconds retry_delay(uint32_t attempt);
 
     const std::string _baseurl;
     const std::string _token;
     const int _collection_id;
     const int _shard_count;
     const int _shard_index;
+    const uint32_t _concurrency;
+    const uint32_t _retries;
     unsigned int _objectCount;
     unsigned int _blockCount;
 
-    // reuse connection across requests
-    void* _curl;
-
-    async                                        async_handler;
-    std::vector<std::vector<char>> prefetch_buffer;
-    uint32_t                                     prefetch_block_num;
-    bool                                         prefetch_pending = false;
-    int                                          m_elements_per_record;
+    std::mutex                                   _handle_mutex;
+    std::vector<void*>                           _idle_handles;
+
+    // requested blocks, guarded by _mutex
+    std::map<uint32_t, std::shared_ptr<request>> _requests;
+    uint64_t                                     _sequence = 0;
+    uint32_t                                     _active = 0;
+    bool                                         _stop = false;
+    std::mutex                                   _mutex;
+    std::condition_variable                      _request_added;
+    std::condition_variable                      _request_done;
+    std::thread                                  _thread;
+    std::minstd_rand0                            _jitter;
 };
@@ -0,0 +1,170 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <iostream>
+#include <algorithm>
+
+#include "block_loader_packed_cache.hpp"
+#include "block_loader_cpio_cache.hpp"
+#include "file_util.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_loader_packed_cache::block_loader_packed_cache(const string& rootCacheDir,
+                                                     const string& cache_id,
+                                                     const string& version,
+                                                     shared_ptr<block_loader> loader) :
+    block_loader(loader->block_size()),
+    _loader(loader),
+    _ownership_lock(-1)
+{
+    block_loader_cpio_cache::invalidate_old_cache(rootCacheDir, cache_id, version);
+
+    // the suffix keeps this apart from a cpio cache of the same dataset
+    _cacheDir = file_util::path_join(rootCacheDir, cache_id + "_" + version + "_packed");
+    file_util::make_directory(_cacheDir);
+
+    if(check_if_complete()) {
+        open_reader();
+    } else if(take_ownership() == false) {
+        throw std::runtime_error("dataloader cache incomplete, try again later");
+    }
+}
+
+block_loader_packed_cache::~block_loader_packed_cache()
+{
+    release_ownership();
+}
+
+void block_loader_packed_cache::load_block(buffer_in_array& dest, uint32_t block_num)
+{
+    uint64_t begin, end;
+    block_range(block_num, begin, end);
+
+    if(_reader) {
+        _reader->read_records(dest, begin, end);
+        return;
+    }
+
+    // until every block was seen, blocks written in an earlier epoch are read
+    // back from the unfinished file.  Only blocks that failed are loaded again
+    {
+        lock_guard<mutex> lock(_writer_mutex);
+        if(_writer && _writer->contains(begin, end)) {
+            _writer->read_records(dest, begin, end);
+            return;
+        }
+    }
+
+    _loader->load_block(dest, block_num);
+
+    try {
+        write_block_to_cache(dest, block_num);
+
+        if(_writer->complete()) {
+            mark_cache_complete();
+            release_ownership();
+        }
+    } catch (std::exception& e) {
+        // failure to write block to cache doesn't stop execution, only print an error
+        cerr << "ERROR writing block to cache: " << e.what() << endl;
+    }
+}
+
+void block_loader_packed_cache::prefetch_block(uint32_t block_num)
+{
+    if(_reader) {
+        uint64_t begin, end;
+        block_range(block_num, begin, end);
+        _reader->prefetch(begin, end);
+    } else {
+        _loader->prefetch_block(block_num);
+    }
+}
+
+uint32_t block_loader_packed_cache::object_count()
+{
+    return _loader->object_count();
+}
+
+shared_ptr<record_source> block_loader_packed_cache::get_record_source()
+{
+    return _reader;
+}
+
+void block_loader_packed_cache::write_block_to_cache(buffer_in_array& buff, uint32_t block_num)
+{
+    uint64_t begin, end;
+    block_range(block_num, begin, end);
+    if(buff[0]->get_item_count() != end - begin) {
+        throw std::runtime_error("block " + to_string(block_num) + " has the wrong number of records");
+    }
+
+    {
+        lock_guard<mutex> lock(_writer_mutex);
+        if(!_writer) {
+            string file = file_util::path_join(_cacheDir, packed_filename);
+            _writer.reset(new packed_file::writer(file, object_count(), buff.size()));
+        }
+    }
+    _writer->write_records(buff, begin);
+}
+
+bool block_loader_packed_cache::check_if_complete()
+{
+    return file_util::exists(file_util::path_join(_cacheDir, packed_filename));
+}
+
+void block_loader_packed_cache::mark_cache_complete()
+{
+    lock_guard<mutex> lock(_writer_mutex);
+    if(_writer) {
+        _writer->close();
+        _writer.reset();
+    }
+    open_reader();
+}
+
+bool block_loader_packed_cache::take_ownership()
+{
+    string file = file_util::path_join(_cacheDir, owner_lock_filename);
+    _ownership_lock = file_util::try_get_lock(file);
+    return _ownership_lock != -1;
+}
+
+void block_loader_packed_cache::release_ownership()
+{
+    string file = file_util::path_join(_cacheDir, owner_lock_filename);
+    file_util::release_lock(_ownership_lock, file);
+    _ownership_lock = -1;
+}
+
+void block_loader_packed_cache::open_reader()
+{
+    string file = file_util::path_join(_cacheDir, packed_filename);
+    _reader = make_shared<packed_file::reader>(file);
+    if(_reader->record_count() != object_count()) {
+        throw std::runtime_error(file + " does not match the manifest, remove it to rebuild the cache");
+    }
+}
+
+void block_loader_packed_cache::block_range(uint32_t block_num, uint64_t& begin, uint64_t& end)
+{
+    begin = (uint64_t)block_num * _block_size;
+    end   = min<uint64_t>(begin + _block_size, object_count());
+    affirm(begin < end, "block_num out of range");
+}
@@ -0,0 +1,78 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+
+#include "block_loader.hpp"
+#include "packed_file.hpp"
+
+/* block_loader_packed_cache
+ *
+ * Same role as block_loader_cpio_cache, but the whole dataset is cached in a
+ * single packed_file.  Records are indexed individually, so the cache does not
+ * depend on the macrobatch size and is reused when it changes.
+ *
+ * The first epoch loads blocks from `loader` and appends them to the file.
+ * Once every block was seen the index is written and later blocks are read
+ * straight from the memory mapped file.  If some block could not be loaded,
+ * later epochs read the blocks already written back from the unfinished file
+ * and only load the missing ones from `loader`.
+ */
+
+namespace nervana
+{
+    class block_loader_packed_cache;
+}
+
+class nervana::block_loader_packed_cache : public block_loader
+{
+public:
+    block_loader_packed_cache(const std::string& rootCacheDir,
+                              const std::string& cache_id, const std::string& version,
+                              std::shared_ptr<block_loader> loader);
+    ~block_loader_packed_cache();
+
+    void load_block(nervana::buffer_in_array& dest, uint32_t block_num) override;
+    void prefetch_block(uint32_t block_num) override;
+    uint32_t prefetch_depth() override { return _loader->prefetch_depth(); }
+    uint32_t object_count() override;
+    std::shared_ptr<record_source> get_record_source() override;
+
+    // used by tools which fill the cache out of band (aeon-cache-build), see
+    // block_loader_cpio_cache.  write_block_to_cache is thread safe.
+    void write_block_to_cache(nervana::buffer_in_array& dest, uint32_t block_num);
+    bool check_if_complete();
+    void mark_cache_complete();
+    void release_ownership();
+
+private:
+    bool take_ownership();
+    void open_reader();
+    void block_range(uint32_t block_num, uint64_t& begin, uint64_t& end);
+
+    const std::string owner_lock_filename = "caching_in_progress";
+    const std::string packed_filename = "records.pack";
+
+    std::string                             _cacheDir;
+    std::shared_ptr<block_loader>           _loader;
+    std::shared_ptr<packed_file::reader>    _reader;
+    std::unique_ptr<packed_file::writer>    _writer;
+    std::mutex                              _writer_mutex;
+    int                                     _ownership_lock;
+};
@@ -29,6 +29,7 @@ using namespace nervana;
 void buffer_in::reset()
 {
     buffers.clear();
+    exceptions.clear();
 }
 
 void buffer_in::shuffle(uint32_t random_seed)
@@ -38,6 +39,11 @@ void buffer_in::shuffle(uint32_t random_seed)
 }
 
 vector<char>& buffer_in::get_item(int index)
+{
+    return *get_shared_item(index);
+}
+
+shared_ptr<vector<char>> buffer_in::get_shared_item(int index)
 {
     if (index >= (int) buffers.size()) {
         throw invalid_argument("index out-of-range");
@@ -53,12 +59,17 @@ vector<char>& buffer_in::get_item(int index)
 
 void buffer_in::add_item(const std::vector<char>& buf)
 {
-    buffers.push_back(buf);
+    buffers.push_back(make_shared<vector<char>>(buf));
 }
 
 void buffer_in::add_item(std::vector<char>&& buf)
 {
-    buffers.push_back(move(buf));
+    buffers.push_back(make_shared<vector<char>>(move(buf)));
+}
+
+void buffer_in::add_item(shared_ptr<vector<char>> buf)
+{
+    buffers.push_back(buf);
 }
 
 void buffer_in::add_exception(std::exception_ptr e)
@@ -67,8 +78,7 @@ void buffer_in::add_exception(std::exception_ptr e)
     exceptions[buffers.size()] = e;
 
     // also add an empty vector to buffers to that indicies line up
-    std::vector<char> empty;
-    buffers.push_back(empty);
+    buffers.push_back(make_shared<vector<char>>());
 }
 
 int buffer_in::get_item_count() {
@@ -78,7 +88,7 @@ int buffer_in::get_item_count() {
 void buffer_in::read(istream& is, int size)
 {
     // read `size` bytes out of `ifs` and push into buffer
-    vector<char> b(size);
-    is.read(b.data(), size);
+    auto b = make_shared<vector<char>>(size);
+    is.read(b->data(), size);
     buffers.push_back(b);
 }
@@ -22,6 +22,7 @@
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
 
 namespace nervana
 {
@@ -40,6 +41,11 @@ public:
     std::vector<char>& get_item(int index);
     void add_item(const std::vector<char>&);
     void add_item(std::vector<char>&&);
+
+    // items may be shared between buffers (and with block_loader_memory_cache)
+    // without copying.  Shared items must be treated as read only.
+    std::shared_ptr<std::vector<char>> get_shared_item(int index);
+    void add_item(std::shared_ptr<std::vector<char>>);
     void add_exception(std::exception_ptr);
 
     void shuffle(uint32_t random_seed);
@@ -47,7 +53,7 @@ public:
     int get_item_count();
 
 private:
-    std::vector<std::vector<char>> buffers;
+    std::vector<std::shared_ptr<std::vector<char>>> buffers;
     std::map<int, std::exception_ptr> exceptions;
 };
 
@@ -0,0 +1,177 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "cache_eviction.hpp"
+#include "file_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+const string cache_eviction::block_extension = ".cpio";
+const string cache_eviction::owner_lock_filename = "caching_in_progress";
+
+namespace
+{
+    struct cached_block
+    {
+        string  dir;
+        string  filename;
+        time_t  mtime;
+        size_t  size;
+    };
+
+    bool ends_with(const string& s, const string& suffix)
+    {
+        return s.size() >= suffix.size() &&
+               s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // list the cpio blocks held in the dataset directories directly below root
+    vector<cached_block> list_blocks(const string& root)
+    {
+        vector<cached_block> rc;
+        DIR* root_dir = opendir(root.c_str());
+        if(root_dir == nullptr) {
+            return rc;
+        }
+        struct dirent* dataset;
+        while((dataset = readdir(root_dir)) != nullptr) {
+            string name = dataset->d_name;
+            if(dataset->d_type != DT_DIR || name == "." || name == "..") {
+                continue;
+            }
+            string dataset_dir = file_util::path_join(root, name);
+            DIR* dir = opendir(dataset_dir.c_str());
+            if(dir == nullptr) {
+                continue;
+            }
+            struct dirent* ent;
+            while((ent = readdir(dir)) != nullptr) {
+                string filename = ent->d_name;
+                if(ent->d_type != DT_REG || !ends_with(filename, cache_eviction::block_extension)) {
+                    continue;
+                }
+                filename = file_util::path_join(dataset_dir, filename);
+                struct stat stats;
+                if(stat(filename.c_str(), &stats) == 0) {
+                    rc.push_back({dataset_dir, filename, stats.st_mtime, (size_t)stats.st_size});
+                }
+            }
+            closedir(dir);
+        }
+        closedir(root_dir);
+        return rc;
+    }
+}
+
+cache_eviction::cache_eviction(const string& root_cache_dir, size_t max_bytes, float low_water) :
+    _root_cache_dir(root_cache_dir),
+    _max_bytes(max_bytes),
+    _low_water_bytes(max_bytes * low_water),
+    _usage(0)
+{
+    enforce_limit();
+}
+
+void cache_eviction::block_accessed(const string& filename)
+{
+    // failure only means the block was evicted by someone else in the meantime
+    utimes(filename.c_str(), nullptr);
+}
+
+void cache_eviction::block_written(const string& filename)
+{
+    lock_guard<mutex> lock(_mutex);
+    if(file_util::exists(filename)) {
+        _usage += file_util::get_file_size(filename);
+    }
+    if(_usage > _max_bytes) {
+        // other processes may have written or evicted blocks since we last
+        // looked, so rescan before deciding what to remove
+        evict(filename);
+    }
+}
+
+void cache_eviction::enforce_limit(const string& keep_filename)
+{
+    lock_guard<mutex> lock(_mutex);
+    evict(keep_filename);
+}
+
+size_t cache_eviction::usage()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _usage;
+}
+
+void cache_eviction::evict(const string& keep_filename)
+{
+    vector<cached_block> blocks = list_blocks(_root_cache_dir);
+
+    size_t usage = 0;
+    map<string, time_t> dataset_time;
+    map<string, int>    dataset_blocks;
+    for(const cached_block& block : blocks) {
+        usage += block.size;
+        dataset_time[block.dir] = max(dataset_time[block.dir], block.mtime);
+        dataset_blocks[block.dir]++;
+    }
+
+    if(usage > _max_bytes) {
+        // least recently used dataset first, then least recently used block
+        sort(blocks.begin(), blocks.end(), [&](const cached_block& a, const cached_block& b) {
+            if(dataset_time[a.dir] != dataset_time[b.dir]) {
+                return dataset_time[a.dir] < dataset_time[b.dir];
+            }
+            if(a.mtime != b.mtime) {
+                return a.mtime < b.mtime;
+            }
+            return a.filename < b.filename;
+        });
+
+        for(const cached_block& block : blocks) {
+            if(usage <= _low_water_bytes) {
+                break;
+            }
+            if(block.filename == keep_filename) {
+                continue;
+            }
+            if(remove(block.filename.c_str()) == 0) {
+                usage -= block.size;
+                dataset_blocks[block.dir]--;
+            }
+        }
+
+        for(auto& it : dataset_blocks) {
+            // a dataset with no blocks left is dropped as a whole, unless its
+            // owner is still in the middle of writing it
+            string lock = file_util::path_join(it.first, owner_lock_filename);
+            if(it.second == 0 && !file_util::exists(lock)) {
+                file_util::remove_directory(it.first);
+            }
+        }
+    }
+
+    _usage = usage;
+}
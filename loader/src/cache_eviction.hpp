@@ -0,0 +1,71 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <mutex>
+
+/* cache_eviction
+ *
+ * Keeps the total size of the cpio blocks under a root cache directory below
+ * `max_bytes`.  The root directory holds one subdirectory per dataset (see
+ * block_loader_cpio_cache) and may be shared by many processes.
+ *
+ * Access times are kept in the modification time of each block file, which is
+ * bumped every time a block is read from the cache.  A dataset was last used
+ * when its most recently used block was.  When the limit is exceeded, blocks of
+ * the least recently used datasets are removed first, oldest block first, until
+ * usage drops to `low_water` of the limit.  Datasets left without blocks are
+ * removed entirely unless another process is still writing them.
+ *
+ * Evicted blocks of a dataset that is still in use are simply missing from the
+ * cache; block_loader_cpio_cache refills them from the source on next access.
+ */
+
+namespace nervana
+{
+    class cache_eviction;
+}
+
+class nervana::cache_eviction
+{
+public:
+    cache_eviction(const std::string& root_cache_dir, size_t max_bytes, float low_water = 0.9);
+
+    // bump the access time of a block that was just read from the cache
+    void block_accessed(const std::string& filename);
+
+    // account for a block that was just written and evict if over the limit
+    void block_written(const std::string& filename);
+
+    // scan the root cache directory and evict until under the low water mark
+    void enforce_limit(const std::string& keep_filename = "");
+
+    size_t usage();
+    size_t max_bytes() const { return _max_bytes; }
+
+    static const std::string block_extension;
+    static const std::string owner_lock_filename;
+
+private:
+    void evict(const std::string& keep_filename);
+
+    const std::string   _root_cache_dir;
+    const size_t        _max_bytes;
+    const size_t        _low_water_bytes;
+    size_t              _usage;
+    std::mutex          _mutex;
+};
@@ -13,6 +13,8 @@
  limitations under the License.
 */
 
+#include <unistd.h>
+
 #include "cpio.hpp"
 #include "util.hpp"
 
@@ -78,7 +80,7 @@ void cpio::record_header::saveDoubleShort(ushort* dst, uint32_t src)
     dst[1] = (ushort) src;
 }
 
-void cpio::record_header::read(istream& ifs, uint32_t* fileSize)
+void cpio::record_header::read(istream& ifs, uint32_t* fileSize, string* fileName)
 {
     read_single_value(ifs, &_magic);
     affirm(_magic == 070707, "CPIO header magic incorrect");
@@ -95,8 +97,15 @@ void cpio::record_header::read(istream& ifs, uint32_t* fileSize)
     read_single_value(ifs, &_namesize);
     read_single_value(ifs, &_filesize);
     loadDoubleShort(fileSize, _filesize);
-    // Skip over filename.
-    ifs.seekg(_namesize, ifs.cur);
+    if(fileName) {
+        vector<char> name(_namesize);
+        ifs.read(name.data(), name.size());
+        // the stored name includes the terminating 0
+        fileName->assign(name.data(), strnlen(name.data(), name.size()));
+    } else {
+        // Skip over filename.
+        ifs.seekg(_namesize, ifs.cur);
+    }
     readPadding(ifs, _namesize);
 }
 
@@ -211,11 +220,114 @@ void cpio::reader::read(vector<char>& dest)
     readPadding(*_is, element_size);
 }
 
+void cpio::reader::skip(string& name, uint32_t& size, streamoff& offset)
+{
+    _recordHeader.read(*_is, &size, &name);
+    offset = _is->tellg();
+    _is->seekg(size, _is->cur);
+    readPadding(*_is, size);
+}
+
 int cpio::reader::itemCount()
 {
     return _header._itemCount;
 }
 
+cpio::stream_reader::stream_reader(function<void(vector<char>&&)> element) :
+    _element(element),
+    _state(state::record_header),
+    _filled(0),
+    _skip(0),
+    _namesize(0),
+    _entries(0)
+{
+}
+
+void cpio::stream_reader::write(const char* data, size_t size)
+{
+    while(size > 0 && _state != state::done) {
+        size_t count;
+        if(_skip > 0) {
+            // padding after an odd sized name or entry
+            count = min(_skip, size);
+            _skip -= count;
+        } else if(_state == state::record_header) {
+            count = min(sizeof(_record_header) - _filled, size);
+            memcpy(_record_header + _filled, data, count);
+            _filled += count;
+            if(_filled == sizeof(_record_header)) {
+                // the same layout record_header::read reads field by field
+                uint16_t magic;
+                memcpy(&magic, _record_header, sizeof(magic));
+                affirm(magic == 070707, "CPIO header magic incorrect");
+                memcpy(&_namesize, _record_header + 20, sizeof(_namesize));
+                uint16_t filesize[2];
+                memcpy(filesize, _record_header + 22, sizeof(filesize));
+                _data.resize(((uint32_t)filesize[0]) << 16 | (uint32_t)filesize[1]);
+                _name.clear();
+                _filled = 0;
+                _state = state::name;
+                if(_namesize == 0) {
+                    start_data();
+                }
+            }
+        } else if(_state == state::name) {
+            count = min(_namesize - _name.size(), size);
+            _name.append(data, count);
+            if(_name.size() == _namesize) {
+                _skip = _namesize % 2;
+                start_data();
+            }
+        } else {
+            count = min(_data.size() - _filled, size);
+            memcpy(_data.data() + _filled, data, count);
+            _filled += count;
+            if(_filled == _data.size()) {
+                end_entry();
+            }
+        }
+        data += count;
+        size -= count;
+    }
+}
+
+void cpio::stream_reader::start_data()
+{
+    // the stored name includes the terminating 0
+    _name.resize(strnlen(_name.data(), _name.size()));
+    _filled = 0;
+    _state = state::data;
+    if(_data.empty()) {
+        end_entry();
+    }
+}
+
+void cpio::stream_reader::end_entry()
+{
+    _skip += _data.size() % 2;
+    _filled = 0;
+    _state = state::record_header;
+
+    if(_entries++ == 0) {
+        if(_data.size() != sizeof(_header)) {
+            stringstream ss;
+            ss << "unexpected header size.  expected " << sizeof(_header);
+            ss << " found " << _data.size();
+            throw std::runtime_error(ss.str());
+        }
+        memcpy(&_header, _data.data(), sizeof(_header));
+        if (strncmp(_header._magic, MAGIC_STRING, 4) != 0) {
+            throw std::runtime_error("Unrecognized format\n");
+        }
+    } else if(_name == CPIO_FOOTER) {
+        _state = state::done;
+    } else if(_name != "cpiotlr" && _name != "cpiotrl") {
+        // the trailer is named cpiotlr by file_writer and cpiotrl by the python writers
+        _element(move(_data));
+    }
+    _data = vector<char>();
+}
+
 cpio::file_reader::file_reader()
 {
 }
@@ -255,7 +367,9 @@ void cpio::file_writer::open(const std::string& fileName, const std::string& dat
 {
     static_assert(sizeof(_header) == 64, "file header is not 64 bytes");
     _fileName = fileName;
-    _tempName = fileName + ".tmp";
+    // several processes may refill the same evicted block at once so the
+    // temporary name must be unique to this process
+    _tempName = fileName + "." + to_string(getpid()) + ".tmp";
     _ofs.open(_tempName, ostream::binary);
     _recordHeader.write(_ofs, 64, "cpiohdr");
     _fileHeaderOffset = _ofs.tellp();
@@ -26,6 +26,7 @@
 #include <cassert>
 #include <cstring>
 #include <sstream>
+#include <functional>
 
 #include "buffer_in.hpp"
 
@@ -42,6 +43,7 @@ namespace nervana
         class header;
         class trailer;
         class reader;
+        class stream_reader;
         class file_reader;
         class file_writer;
     }
@@ -75,7 +77,7 @@ public:
 
     void saveDoubleShort(uint16_t* dst, uint32_t src);
 
-    void read(std::istream& ifs, uint32_t* fileSize);
+    void read(std::istream& ifs, uint32_t* fileSize, std::string* fileName = nullptr);
 
     void write(std::ostream& ofs, uint32_t fileSize, const char* fileName);
 
@@ -96,6 +98,7 @@ public:
 class nervana::cpio::header
 {
 friend class reader;
+friend class stream_reader;
 friend class file_writer;
 public:
     header();
@@ -133,6 +136,10 @@ public:
     void read(nervana::buffer_in& dest);
     void read(std::vector<char>& dest);
 
+    // skip over the next entry, returning its name and where its data is in
+    // the stream
+    void skip(std::string& name, uint32_t& size, std::streamoff& offset);
+
     int itemCount() ;
 
 protected:
@@ -145,6 +152,51 @@ protected:
     record_header   _recordHeader;
 };
 
+/*
+ * stream_reader parses an archive that is pushed to it in pieces of any size,
+ * e.g. as it arrives over the network, so the archive is never held in
+ * memory as a whole.  The data of each entry is written straight into the
+ * vector that is then handed to `element`; entries come out in archive
+ * order, i.e. record by record and element by element within a record.
+ */
+
+class nervana::cpio::stream_reader
+{
+public:
+    stream_reader(std::function<void(std::vector<char>&&)> element);
+
+    void write(const char* data, size_t size);
+
+    // the footer has been read, anything after it is ignored
+    bool complete() const { return _state == state::done; }
+
+    // only valid once the archive header has been read
+    int itemCount() const { return _header._itemCount; }
+
+private:
+    enum class state
+    {
+        record_header,
+        name,
+        data,
+        done
+    };
+
+    void start_data();
+    void end_entry();
+
+    std::function<void(std::vector<char>&&)> _element;
+    state               _state;
+    header              _header;
+    char                _record_header[26];
+    size_t              _filled;
+    size_t              _skip;
+    uint16_t            _namesize;
+    std::string         _name;
+    std::vector<char>   _data;
+    uint32_t            _entries;
+};
+
 /*
  * CPIOFileReader wraps file opening around the more generic CPIOReader
  * which only deals in istreams
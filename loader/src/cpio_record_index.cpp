@@ -0,0 +1,178 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include "cpio_record_index.hpp"
+#include "cpio.hpp"
+
+using namespace std;
+using namespace nervana;
+
+cpio_record_index::cpio_record_index(const vector<string>& block_files, size_t max_gap) :
+    _files(block_files),
+    _max_gap(max_gap),
+    _elements(0)
+{
+    vector<element_location> elements;
+    for(uint32_t file=0; file<_files.size(); file++) {
+        cpio::file_reader reader;
+        if(!reader.open(_files[file])) {
+            throw runtime_error("unable to open cache file " + _files[file]);
+        }
+        int records = reader.itemCount();
+
+        // the element count per record is not stored, count the entries up to
+        // the trailer
+        elements.clear();
+        while(true) {
+            string name;
+            uint32_t size;
+            streamoff offset;
+            reader.skip(name, size, offset);
+            if(name == "cpiotlr") {
+                break;
+            }
+            if(name.compare(0, 4, "rec_") != 0) {
+                throw runtime_error("unexpected entry " + name + " in cache file " + _files[file]);
+            }
+            elements.push_back({(uint64_t)offset, size});
+        }
+
+        if(records > 0) {
+            uint32_t elements_per_record = elements.size() / records;
+            if(_elements == 0) {
+                _elements = elements_per_record;
+            }
+            if(elements_per_record != _elements || elements.size() % records != 0) {
+                throw runtime_error("unexpected layout of cache file " + _files[file]);
+            }
+        }
+        for(int i=0; i<records; i++) {
+            _record_file.push_back(file);
+        }
+        _locations.insert(_locations.end(), elements.begin(), elements.end());
+    }
+}
+
+void cpio_record_index::read_records(buffer_in_array& dest, const vector<uint64_t>& records) const
+{
+    if(dest.size() != _elements) {
+        throw invalid_argument("cpio_record_index: wrong number of elements per record");
+    }
+
+    struct request
+    {
+        size_t      position;   // in `records`
+        uint32_t    file;
+        uint64_t    begin;
+        uint64_t    end;
+    };
+    vector<request> requests;
+    for(size_t i=0; i<records.size(); i++) {
+        uint64_t record = records[i];
+        if(record >= _record_file.size()) {
+            throw invalid_argument("cpio_record_index: record index out of range");
+        }
+        // elements of a record follow each other, only separated by headers
+        const element_location* loc = &_locations[record * _elements];
+        uint64_t end = loc[_elements - 1].offset + loc[_elements - 1].size;
+        requests.push_back({i, _record_file[record], loc[0].offset, end});
+    }
+    sort(requests.begin(), requests.end(), [](const request& a, const request& b) {
+        return a.file != b.file ? a.file < b.file : a.begin < b.begin;
+    });
+
+    // coalesce neighbouring records into runs, [first, last) in `requests`
+    struct run
+    {
+        size_t      first;
+        size_t      last;
+        uint64_t    begin;
+        uint64_t    end;
+    };
+    vector<run> runs;
+    for(size_t i=0; i<requests.size(); i++) {
+        const request& r = requests[i];
+        if(!runs.empty() && requests[runs.back().first].file == r.file &&
+           r.begin <= runs.back().end + _max_gap) {
+            runs.back().last = i + 1;
+            runs.back().end  = max(runs.back().end, r.end);
+        } else {
+            runs.push_back({i, i + 1, r.begin, r.end});
+        }
+    }
+
+    map<uint32_t, int> fds;
+    auto close_files = [&]() {
+        for(auto& f : fds) {
+            close(f.second);
+        }
+    };
+
+    vector<vector<vector<char>>> items(records.size(), vector<vector<char>>(_elements));
+    try {
+        for(const run& r : runs) {
+            uint32_t file = requests[r.first].file;
+            if(fds.find(file) == fds.end()) {
+                int fd = open(_files[file].c_str(), O_RDONLY);
+                if(fd < 0) {
+                    throw runtime_error("unable to open cache file " + _files[file] + ": " + strerror(errno));
+                }
+                fds[file] = fd;
+            }
+            posix_fadvise(fds[file], r.begin, r.end - r.begin, POSIX_FADV_WILLNEED);
+        }
+
+        vector<char> buffer;
+        for(const run& r : runs) {
+            uint32_t file = requests[r.first].file;
+            buffer.resize(r.end - r.begin);
+            size_t done = 0;
+            while(done < buffer.size()) {
+                ssize_t rc = pread(fds[file], buffer.data() + done, buffer.size() - done, r.begin + done);
+                if(rc <= 0) {
+                    throw runtime_error("error reading cache file " + _files[file]);
+                }
+                done += rc;
+            }
+
+            for(size_t i=r.first; i<r.last; i++) {
+                const request& req = requests[i];
+                const element_location* loc = &_locations[records[req.position] * _elements];
+                for(uint32_t j=0; j<_elements; j++) {
+                    const char* p = buffer.data() + (loc[j].offset - r.begin);
+                    items[req.position][j].assign(p, p + loc[j].size);
+                }
+            }
+        }
+    } catch(...) {
+        close_files();
+        throw;
+    }
+    close_files();
+
+    for(size_t i=0; i<records.size(); i++) {
+        for(uint32_t j=0; j<_elements; j++) {
+            dest[j]->add_item(move(items[i][j]));
+        }
+    }
+}
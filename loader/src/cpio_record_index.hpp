@@ -0,0 +1,63 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "record_source.hpp"
+
+/* cpio_record_index
+ *
+ * record_source over the block files of a complete cpio cache.  The files are
+ * scanned once to find the offset of every element, after which records are
+ * read with pread.
+ *
+ * read_records sorts the requested records by file and offset and merges
+ * records that are at most `max_gap` bytes apart into one read, so the disk
+ * sees few, ascending requests.  All reads of a call are announced to the
+ * kernel up front so that it can keep several in flight.
+ */
+
+namespace nervana
+{
+    class cpio_record_index;
+}
+
+class nervana::cpio_record_index : public record_source
+{
+public:
+    // `block_files` in block order, record numbers follow the file order
+    cpio_record_index(const std::vector<std::string>& block_files, size_t max_gap = 64 * 1024);
+
+    uint64_t record_count() const override { return _record_file.size(); }
+    uint32_t elements_per_record() const { return _elements; }
+
+    void read_records(nervana::buffer_in_array& dest, const std::vector<uint64_t>& records) const override;
+
+private:
+    struct element_location
+    {
+        uint64_t    offset;
+        uint64_t    size;
+    };
+
+    std::vector<std::string>        _files;
+    size_t                          _max_gap;
+    uint32_t                        _elements;
+    std::vector<uint32_t>           _record_file;
+    std::vector<element_location>   _locations;
+};
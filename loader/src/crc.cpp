@@ -18,6 +18,36 @@ void ThrowIfInvalidTruncatedSize(size_t size)
 # undef CRYPTOPP_BOOL_SSE4_INTRINSICS_AVAILABLE
 #endif
 
+// SSE4.2 crc32 instruction, compiled for that target only and selected at run
+// time so the library still runs on older CPUs
+#if defined(__GNUC__) && defined(__x86_64__)
+# define AEON_CRC32C_SSE42 1
+# include <nmmintrin.h>
+
+static bool HasSSE42()
+{
+	static const bool rc = __builtin_cpu_supports("sse4.2");
+	return rc;
+}
+
+__attribute__((target("sse4.2")))
+static word32 CRC32C_SSE42(word32 crc, const byte *s, size_t n)
+{
+	for(; !IsAligned<uint64_t>(s) && n > 0; s++, n--)
+		crc = _mm_crc32_u8(crc, *s);
+
+	uint64_t crc64 = crc;
+	for(; n >= 8; s+=8, n-=8)
+		crc64 = _mm_crc32_u64(crc64, *(const uint64_t *)(void*)s);
+	crc = (word32)crc64;
+
+	for(; n > 0; s++, n--)
+		crc = _mm_crc32_u8(crc, *s);
+
+	return crc;
+}
+#endif
+
 /* Table of CRC-32's of all single byte values (made by makecrc.c) */
 const word32 CRC32::m_tab[] = {
 #ifdef IS_LITTLE_ENDIAN
@@ -304,6 +334,13 @@ CRC32C::CRC32C()
 
 void CRC32C::Update(const byte *s, size_t n)
 {
+#if AEON_CRC32C_SSE42
+	if (HasSSE42())
+	{
+		m_crc = CRC32C_SSE42(m_crc, s, n);
+		return;
+	}
+#endif
 #if CRYPTOPP_BOOL_SSE4_INTRINSICS_AVAILABLE
 	if (HasSSE4())
 	{
@@ -367,4 +404,60 @@ void CRC32C::TruncatedFinal(byte *hash, size_t size)
 	Reset();
 }
 
+// GF(2) matrix helpers for CRC32C_Combine, after crc32_combine in zlib
+static word32 GF2MatrixTimes(const word32 *mat, word32 vec)
+{
+	word32 sum = 0;
+	for(; vec; vec >>= 1, mat++)
+		if (vec & 1)
+			sum ^= *mat;
+	return sum;
+}
+
+static void GF2MatrixSquare(word32 *square, const word32 *mat)
+{
+	for (int n = 0; n < 32; n++)
+		square[n] = GF2MatrixTimes(mat, mat[n]);
+}
+
+word32 CRC32C_Combine(word32 crc1, word32 crc2, size_t len2)
+{
+	if (len2 == 0)
+		return crc1;
+
+	word32 even[32];	// even-power-of-two zeros operator
+	word32 odd[32];		// odd-power-of-two zeros operator
+
+	// operator for one zero bit in odd
+	odd[0] = 0x82F63B78L;
+	word32 row = 1;
+	for (int n = 1; n < 32; n++)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	GF2MatrixSquare(even, odd);	// two zero bits
+	GF2MatrixSquare(odd, even);	// four zero bits
+
+	// apply len2 zeros to crc1, the first square puts the operator for one
+	// zero byte (eight zero bits) in even
+	do
+	{
+		GF2MatrixSquare(even, odd);
+		if (len2 & 1)
+			crc1 = GF2MatrixTimes(even, crc1);
+		len2 >>= 1;
+		if (len2 == 0)
+			break;
+
+		GF2MatrixSquare(odd, even);
+		if (len2 & 1)
+			crc1 = GF2MatrixTimes(odd, crc1);
+		len2 >>= 1;
+	} while (len2 != 0);
+
+	return crc1 ^ crc2;
+}
+
 }
@@ -92,6 +92,11 @@ private:
 	word32 m_crc;
 };
 
+//! \brief CRC-32C of the concatenation of two blocks
+//! \details crc1 and crc2 are the finalized CRC-32C of the first and second
+//!   block and len2 the length of the second, as crc32_combine in zlib
+word32 CRC32C_Combine(word32 crc1, word32 crc2, size_t len2);
+
 }
 
 #endif
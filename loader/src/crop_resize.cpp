@@ -0,0 +1,406 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "crop_resize.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    // the source pixels each output pixel along one axis is made of and
+    // their weights.  Every output pixel has `taps` entries, the ones it
+    // does not need have a weight of 0
+    struct filter
+    {
+        int           taps = 0;
+        vector<int>   index;
+        vector<float> weight;
+    };
+
+    typedef vector<vector<pair<int, float>>> tap_list;
+
+    filter make_filter(const tap_list& pixels)
+    {
+        filter rc;
+        for(auto& taps : pixels) {
+            rc.taps = max<int>(rc.taps, taps.size());
+        }
+        for(auto& taps : pixels) {
+            for(int k=0; k<rc.taps; k++) {
+                auto& tap = taps[min<int>(k, taps.size() - 1)];
+                rc.index.push_back(tap.first);
+                rc.weight.push_back(k < taps.size() ? tap.second : 0);
+            }
+        }
+        return rc;
+    }
+
+    // cv::resize INTER_AREA when shrinking: the average of the source pixels
+    // the output pixel covers, weighted by how much of them it covers
+    filter area_filter(int in, int out)
+    {
+        double scale = (double)in / out;
+        tap_list pixels(out);
+        for(int dx=0; dx<out; dx++) {
+            double fsx1 = dx * scale;
+            double fsx2 = fsx1 + scale;
+            double cell = min(scale, in - fsx1);
+            int sx1 = ceil(fsx1);
+            int sx2 = min<int>(floor(fsx2), in - 1);
+            sx1 = min(sx1, sx2);
+            auto& taps = pixels[dx];
+            if(sx1 - fsx1 > 1e-3) {
+                taps.emplace_back(sx1 - 1, (sx1 - fsx1) / cell);
+            }
+            for(int sx=sx1; sx<sx2; sx++) {
+                taps.emplace_back(sx, 1.0 / cell);
+            }
+            if(fsx2 - sx2 > 1e-3) {
+                taps.emplace_back(sx2, min(min(fsx2 - sx2, 1.0), cell) / cell);
+            }
+        }
+        return make_filter(pixels);
+    }
+
+    // cv::resize INTER_AREA when enlarging along either axis: linear
+    // interpolation that keeps whole source pixels where it can
+    filter area_linear_filter(int in, int out)
+    {
+        double scale = (double)in / out;
+        double inv_scale = (double)out / in;
+        tap_list pixels(out);
+        for(int dx=0; dx<out; dx++) {
+            int sx = floor(dx * scale);
+            float fx = (float)((dx + 1) - (sx + 1) * inv_scale);
+            fx = fx <= 0 ? 0.f : fx - floor(fx);
+            if(sx >= in - 1) {
+                fx = 0;
+                sx = in - 1;
+            }
+            pixels[dx].emplace_back(sx, 1.f - fx);
+            pixels[dx].emplace_back(min(sx + 1, in - 1), fx);
+        }
+        return make_filter(pixels);
+    }
+
+    // cv::resize INTER_CUBIC, with the pixels past the edges replicated
+    filter cubic_filter(int in, int out)
+    {
+        const float A = -0.75f;
+        double scale = (double)in / out;
+        tap_list pixels(out);
+        for(int dx=0; dx<out; dx++) {
+            float fx = (float)((dx + 0.5) * scale - 0.5);
+            int sx = floor(fx);
+            fx -= sx;
+            float w[4];
+            w[0] = ((A * (fx + 1) - 5 * A) * (fx + 1) + 8 * A) * (fx + 1) - 4 * A;
+            w[1] = ((A + 2) * fx - (A + 3)) * fx * fx + 1;
+            w[2] = ((A + 2) * (1 - fx) - (A + 3)) * (1 - fx) * (1 - fx) + 1;
+            w[3] = 1.f - w[0] - w[1] - w[2];
+            for(int k=0; k<4; k++) {
+                pixels[dx].emplace_back(min(max(sx - 1 + k, 0), in - 1), w[k]);
+            }
+        }
+        return make_filter(pixels);
+    }
+
+    filter mirror(const filter& f)
+    {
+        filter rc = f;
+        int count = f.index.size() / f.taps;
+        for(int x=0; x<count; x++) {
+            copy_n(&f.index[(count - 1 - x) * f.taps], f.taps, &rc.index[x * f.taps]);
+            copy_n(&f.weight[(count - 1 - x) * f.taps], f.taps, &rc.weight[x * f.taps]);
+        }
+        return rc;
+    }
+
+    // the weights for the interpolation image::resize asks cv::resize for
+    void make_filters(const cv::Size2i& in, const cv::Size2i& out, filter& fx, filter& fy)
+    {
+        if(in.area() < out.area()) {
+            fx = cubic_filter(in.width, out.width);
+            fy = cubic_filter(in.height, out.height);
+        } else if(in.width >= out.width && in.height >= out.height) {
+            fx = area_filter(in.width, out.width);
+            fy = area_filter(in.height, out.height);
+        } else {
+            fx = area_linear_filter(in.width, out.width);
+            fy = area_linear_filter(in.height, out.height);
+        }
+    }
+
+    // resize one row of interleaved 8 bit pixels horizontally into one plane
+    // per channel
+    template<int channels>
+    void resize_row(const uint8_t* src, const filter& f, int width, float* out)
+    {
+        for(int x=0; x<width; x++) {
+            const int*   index  = &f.index[x * f.taps];
+            const float* weight = &f.weight[x * f.taps];
+            float sum[channels] = {};
+            for(int k=0; k<f.taps; k++) {
+                const uint8_t* p = src + index[k] * channels;
+                for(int c=0; c<channels; c++) {
+                    sum[c] += weight[k] * p[c];
+                }
+            }
+            for(int c=0; c<channels; c++) {
+                out[c * width + x] = sum[c];
+            }
+        }
+    }
+
+    // the weighted sum of `count` horizontally resized rows of `n` values
+    void add_rows(const float* const* rows, const float* weights, int count, int n, float* out)
+    {
+        if(count == 0) {
+            fill_n(out, n, 0.f);
+            return;
+        }
+        int x = 0;
+#if defined(__SSE2__)
+        for(; x <= n - 4; x += 4) {
+            __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + x));
+            for(int k=1; k<count; k++) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + x)));
+            }
+            _mm_storeu_ps(out + x, sum);
+        }
+#endif
+        for(; x<n; x++) {
+            float sum = weights[0] * rows[0][x];
+            for(int k=1; k<count; k++) {
+                sum += weights[k] * rows[k][x];
+            }
+            out[x] = sum;
+        }
+    }
+
+    // the 8 bit pixel value cv::resize rounds to
+    inline int round_pixel(float v)
+    {
+        int i = lrintf(v);
+        return i < 0 ? 0 : (i > 255 ? 255 : i);
+    }
+
+    // store the 8 bit values `in` rounds to as v * scale + offset
+    template<typename T>
+    void store_plane(const float* in, int n, T* out, float scale, float offset)
+    {
+        for(int x=0; x<n; x++) {
+            out[x] = round_pixel(in[x]) * scale + offset;
+        }
+    }
+
+    // 8 bit output is never normalized
+    template<>
+    void store_plane<uint8_t>(const float* in, int n, uint8_t* out, float, float)
+    {
+        int x = 0;
+#if defined(__SSE2__)
+        for(; x <= n - 8; x += 8) {
+            __m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(in + x));
+            __m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(in + x + 4));
+            __m128i v  = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(v, v));
+        }
+#endif
+        for(; x<n; x++) {
+            out[x] = round_pixel(in[x]);
+        }
+    }
+
+    template<>
+    void store_plane<float>(const float* in, int n, float* out, float scale, float offset)
+    {
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 max_value = _mm_set1_ps(255.f);
+        const __m128 scale4 = _mm_set1_ps(scale);
+        const __m128 offset4 = _mm_set1_ps(offset);
+        for(; x <= n - 4; x += 4) {
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + x), zero), max_value);
+            v = _mm_cvtepi32_ps(_mm_cvtps_epi32(v));
+            _mm_storeu_ps(out + x, _mm_add_ps(_mm_mul_ps(v, scale4), offset4));
+        }
+#endif
+        for(; x<n; x++) {
+            out[x] = round_pixel(in[x]) * scale + offset;
+        }
+    }
+
+    // store output row `y` from one plane per channel, channel c mapped by
+    // `scale`[c] and `offset`[c] if given
+    template<typename T>
+    void store_row(const float* in, int width, int channels, bool channel_major,
+                   size_t plane_size, int y, void* output, const float* scale, const float* offset)
+    {
+        T* out = (T*)output;
+        if(channel_major || channels == 1) {
+            for(int c=0; c<channels; c++) {
+                store_plane(in + c * width, width, out + c * plane_size + (size_t)y * width,
+                            scale ? scale[c] : 1.f, offset ? offset[c] : 0.f);
+            }
+        } else {
+            out += (size_t)y * width * channels;
+            for(int x=0; x<width; x++) {
+                for(int c=0; c<channels; c++) {
+                    out[x * channels + c] = round_pixel(in[c * width + x]) * (scale ? scale[c] : 1.f) +
+                                            (offset ? offset[c] : 0.f);
+                }
+            }
+        }
+    }
+
+    typedef void (*store_function)(const float*, int, int, bool, size_t, int, void*, const float*, const float*);
+
+    store_function select_store(int output_type)
+    {
+        switch(output_type) {
+        case CV_8U:  return store_row<uint8_t>;
+        case CV_16U: return store_row<uint16_t>;
+        case CV_16S: return store_row<int16_t>;
+        case CV_32S: return store_row<int32_t>;
+        case CV_32F: return store_row<float>;
+        case CV_64F: return store_row<double>;
+        default:     return nullptr;
+        }
+    }
+
+    // split an 8 bit row into one float plane per channel
+    template<int channels>
+    void deinterleave_row(const uint8_t* in, int width, float* out)
+    {
+        for(int x=0; x<width; x++) {
+            for(int c=0; c<channels; c++) {
+                out[c * width + x] = in[x * channels + c];
+            }
+        }
+    }
+}
+
+bool image::crop_resize(const cv::Mat& input, const cv::Rect& cropbox, const cv::Size2i& output_size,
+                        bool flip, bool channel_major, int output_type, void* output,
+                        const float* channel_scale, const float* channel_offset)
+{
+    int channels = input.channels();
+    if(input.depth() != CV_8U || (channels != 1 && channels != 3)) {
+        return false;
+    }
+    if(channel_scale && output_type != CV_32F) {
+        return false;
+    }
+    store_function store = select_store(output_type);
+    if(store == nullptr) {
+        return false;
+    }
+
+    cv::Mat crop = input(cropbox);
+    filter fx, fy;
+    make_filters(crop.size(), output_size, fx, fy);
+    if(flip) {
+        fx = mirror(fx);
+    }
+
+    int    width      = output_size.width;
+    int    row_size   = width * channels;
+    size_t plane_size = output_size.area();
+
+    // horizontally resized source rows.  The rows an output row needs are
+    // consecutive and move down with it, so a ring of `fy.taps` rows holds
+    // them all and each source row is resized only once
+    int           ring_size = fy.taps;
+    vector<float> ring(ring_size * row_size);
+    vector<int>   ring_row(ring_size, -1);
+
+    vector<const float*> rows(fy.taps);
+    vector<float>        weights(fy.taps);
+    vector<float>        out_row(row_size);
+    for(int y=0; y<output_size.height; y++) {
+        int count = 0;
+        for(int k=0; k<fy.taps; k++) {
+            float weight = fy.weight[y * fy.taps + k];
+            if(weight == 0) {
+                continue;
+            }
+            int    r    = fy.index[y * fy.taps + k];
+            int    slot = r % ring_size;
+            float* row  = &ring[slot * row_size];
+            if(ring_row[slot] != r) {
+                if(channels == 3) {
+                    resize_row<3>(crop.ptr<uint8_t>(r), fx, width, row);
+                } else {
+                    resize_row<1>(crop.ptr<uint8_t>(r), fx, width, row);
+                }
+                ring_row[slot] = r;
+            }
+            rows[count]    = row;
+            weights[count] = weight;
+            count++;
+        }
+        add_rows(rows.data(), weights.data(), count, row_size, out_row.data());
+        store(out_row.data(), width, channels, channel_major, plane_size, y, output,
+              channel_scale, channel_offset);
+    }
+    return true;
+}
+
+bool image::convert(const cv::Mat& input, bool channel_major, int output_type, void* output,
+                    const float* channel_scale, const float* channel_offset)
+{
+    int channels = input.channels();
+    if(input.depth() != CV_8U || (channels != 1 && channels != 3)) {
+        return false;
+    }
+    if(channel_scale && output_type != CV_32F) {
+        return false;
+    }
+    store_function store = select_store(output_type);
+    if(store == nullptr) {
+        return false;
+    }
+
+    int    width      = input.cols;
+    size_t plane_size = input.total();
+    vector<float> row(width * channels);
+    for(int y=0; y<input.rows; y++) {
+        if(channels == 3) {
+            deinterleave_row<3>(input.ptr<uint8_t>(y), width, row.data());
+        } else {
+            deinterleave_row<1>(input.ptr<uint8_t>(y), width, row.data());
+        }
+        store(row.data(), width, channels, channel_major, plane_size, y, output,
+              channel_scale, channel_offset);
+    }
+    return true;
+}
+
+bool image::supports_type(int output_type)
+{
+    return select_store(output_type) != nullptr;
+}
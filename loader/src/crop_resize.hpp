@@ -0,0 +1,64 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+/* crop_resize
+ *
+ * The crop, resize, flip and output conversion of image ETL in a single pass
+ * that writes straight into the output buffer.  The separate steps each make
+ * a full pass over the pixels and leave an intermediate Mat behind, and
+ * image::loader then makes another pass to convert and reorder the channels.
+ *
+ * The resize is separable.  Each source row of the crop is resized
+ * horizontally once into one float plane per channel, flipped if asked for,
+ * and the vertical pass then adds up those rows, rounds and stores whole
+ * output rows.  The vertical pass and the conversion run on SSE2 where
+ * available.
+ *
+ * The weights are the ones cv::resize uses for the interpolation image::resize
+ * picks: area averaging when shrinking and bicubic when enlarging.  Rounding
+ * of the fixed point arithmetic cv::resize uses for 8 bit images can make a
+ * pixel differ by one.
+ */
+
+namespace nervana
+{
+    namespace image
+    {
+        // crop `cropbox` out of `input` (8 bit, 1 or 3 channels), resize it to
+        // `output_size`, mirror it left to right if `flip` and store it at
+        // `output` as `output_type` (CV_8U, CV_16U, CV_16S, CV_32S, CV_32F or
+        // CV_64F), as one plane per channel if `channel_major` or with the
+        // channels interleaved otherwise.  Returns false without writing
+        // anything for types it does not handle.  If `channel_scale` is given,
+        // CV_32F output of channel c is mapped to v * channel_scale[c] +
+        // channel_offset[c]
+        bool crop_resize(const cv::Mat& input, const cv::Rect& cropbox, const cv::Size2i& output_size,
+                         bool flip, bool channel_major, int output_type, void* output,
+                         const float* channel_scale = nullptr, const float* channel_offset = nullptr);
+
+        // store the 8 bit image `input` the way crop_resize() stores its
+        // result, without the crop and resize.  One row at a time goes
+        // through the same vectorized stores
+        bool convert(const cv::Mat& input, bool channel_major, int output_type, void* output,
+                     const float* channel_scale = nullptr, const float* channel_offset = nullptr);
+
+        // true if crop_resize() and convert() can store `output_type`
+        bool supports_type(int output_type);
+    }
+}
@@ -0,0 +1,215 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <map>
+#include <utility>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "decoded_cache.hpp"
+#include "file_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+decoded_cache::decoded_cache(const string& directory, size_t max_bytes) :
+    _data(nullptr),
+    _max_bytes(max_bytes),
+    _size_bytes(0)
+{
+    if(max_bytes == 0) {
+        throw invalid_argument("decoded cache size must be > 0");
+    }
+    file_util::make_directory(directory);
+
+    string filename = file_util::path_join(directory, "decoded_XXXXXX");
+    vector<char> name(filename.begin(), filename.end());
+    name.push_back(0);
+    int fd = mkstemp(name.data());
+    if(fd == -1) {
+        throw runtime_error("unable to create decoded cache in " + directory);
+    }
+    unlink(name.data());
+
+    // the file is sparse, only the part that was written takes up disk space
+    if(ftruncate(fd, max_bytes) != 0) {
+        close(fd);
+        throw runtime_error("unable to size decoded cache in " + directory);
+    }
+    void* data = mmap(nullptr, max_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw runtime_error("unable to map decoded cache in " + directory);
+    }
+    _data = (char*)data;
+}
+
+decoded_cache::~decoded_cache()
+{
+    munmap(_data, _max_bytes);
+}
+
+shared_ptr<decoded_cache> decoded_cache::open(const string& directory, size_t max_bytes)
+{
+    static mutex                               open_mutex;
+    static map<pair<string, size_t>, weak_ptr<decoded_cache>> caches;
+
+    // the size is part of the key so that a later open asking for a
+    // different size does not silently get the first one
+    lock_guard<mutex> lock(open_mutex);
+    weak_ptr<decoded_cache>& entry = caches[make_pair(directory, max_bytes)];
+    shared_ptr<decoded_cache> rc = entry.lock();
+    if(rc == nullptr) {
+        rc = make_shared<decoded_cache>(directory, max_bytes);
+        entry = rc;
+    }
+    return rc;
+}
+
+uint64_t decoded_cache::key(const char* data, size_t size, uint64_t seed)
+{
+    // MurmurHash64A.  A 32 bit crc would collide within a few hundred thousand
+    // records and a collision returns the wrong image.
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (size * m);
+
+    const char* end = data + (size & ~size_t(7));
+    for(const char* p = data; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = (const unsigned char*)end;
+    switch(size & 7) {
+    case 7: h ^= uint64_t(tail[6]) << 48;
+            // fall through
+    case 6: h ^= uint64_t(tail[5]) << 40;
+            // fall through
+    case 5: h ^= uint64_t(tail[4]) << 32;
+            // fall through
+    case 4: h ^= uint64_t(tail[3]) << 24;
+            // fall through
+    case 3: h ^= uint64_t(tail[2]) << 16;
+            // fall through
+    case 2: h ^= uint64_t(tail[1]) << 8;
+            // fall through
+    case 1: h ^= uint64_t(tail[0]);
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+bool decoded_cache::find(uint64_t key, size_t encoded_size, cv::Mat& mat)
+{
+    size_t offset;
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _index.find(key);
+        if(it == _index.end()) {
+            return false;
+        }
+        offset = it->second;
+    }
+
+    // entries are never moved or overwritten once indexed
+    const entry_header* header = (const entry_header*)(_data + offset);
+    if(header->key != key || header->encoded_size != encoded_size) {
+        return false;
+    }
+    cv::Mat cached(header->rows, header->cols, header->type, _data + offset + sizeof(entry_header));
+    mat = cached.clone();
+    return true;
+}
+
+bool decoded_cache::find(uint64_t key, size_t encoded_size, char* output, size_t size)
+{
+    size_t offset;
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _index.find(key);
+        if(it == _index.end()) {
+            return false;
+        }
+        offset = it->second;
+    }
+
+    const entry_header* header = (const entry_header*)(_data + offset);
+    cv::Mat cached(header->rows, header->cols, header->type, _data + offset + sizeof(entry_header));
+    if(header->key != key || header->encoded_size != encoded_size ||
+       cached.total() * cached.elemSize() != size) {
+        return false;
+    }
+    memcpy(output, cached.data, size);
+    return true;
+}
+
+void decoded_cache::add(uint64_t key, size_t encoded_size, const cv::Mat& mat)
+{
+    cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+    size_t data_size = continuous.total() * continuous.elemSize();
+    // keep every entry 8 byte aligned
+    size_t entry_size = (sizeof(entry_header) + data_size + 7) & ~size_t(7);
+
+    size_t offset;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if(_size_bytes + entry_size > _max_bytes || _index.find(key) != _index.end()) {
+            return;
+        }
+        offset = _size_bytes;
+        _size_bytes += entry_size;
+    }
+
+    entry_header* header = (entry_header*)(_data + offset);
+    header->key          = key;
+    header->encoded_size = encoded_size;
+    header->rows         = continuous.rows;
+    header->cols         = continuous.cols;
+    header->type         = continuous.type();
+    header->reserved     = 0;
+    memcpy(_data + offset + sizeof(entry_header), continuous.data, data_size);
+
+    // only publish the entry once it is complete
+    lock_guard<mutex> lock(_mutex);
+    _index[key] = offset;
+}
+
+size_t decoded_cache::size_bytes()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _size_bytes;
+}
+
+size_t decoded_cache::entry_count()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _index.size();
+}
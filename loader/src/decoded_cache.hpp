@@ -0,0 +1,86 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <opencv2/core/core.hpp>
+
+/* decoded_cache
+ *
+ * Stores the output of an extractor (a decoded image or audio clip) so that
+ * later epochs can skip decoding.  Entries are raw cv::Mat pixels or samples
+ * appended to a single file in `directory` which is memory mapped, so the
+ * operating system decides how much of it stays in RAM.  The file is unlinked
+ * as soon as it is created and lives only as long as the cache.
+ *
+ * Entries are keyed by a hash of the encoded bytes (see key()), which needs no
+ * record index and gives the same key in every epoch whatever the shuffle
+ * order.  Extractors mix their decode settings into the seed so that
+ * differently decoded versions of the same file do not collide.
+ *
+ * Once `max_bytes` is used up no further entries are added.
+ */
+
+namespace nervana
+{
+    class decoded_cache;
+}
+
+class nervana::decoded_cache
+{
+public:
+    decoded_cache(const std::string& directory, size_t max_bytes);
+    ~decoded_cache();
+
+    // one cache per directory and size is shared by all extractors of a
+    // process, the decode threads each have their own provider
+    static std::shared_ptr<decoded_cache> open(const std::string& directory, size_t max_bytes);
+
+    static uint64_t key(const char* data, size_t size, uint64_t seed);
+
+    // on a hit `mat` receives a copy of the cached data.  Transformers are
+    // allowed to modify their input in place so the mapping is never handed out.
+    bool find(uint64_t key, size_t encoded_size, cv::Mat& mat);
+
+    // copy the cached data straight to `output` if it is `size` bytes long
+    bool find(uint64_t key, size_t encoded_size, char* output, size_t size);
+    void add(uint64_t key, size_t encoded_size, const cv::Mat& mat);
+
+    size_t size_bytes();
+    size_t entry_count();
+
+private:
+    struct entry_header
+    {
+        uint64_t    key;
+        uint64_t    encoded_size;
+        int32_t     rows;
+        int32_t     cols;
+        int32_t     type;
+        int32_t     reserved;
+    };
+
+    decoded_cache(const decoded_cache&) = delete;
+
+    char*                               _data;
+    size_t                              _max_bytes;
+    size_t                              _size_bytes;
+    std::unordered_map<uint64_t, size_t> _index;
+    std::mutex                          _mutex;
+};
@@ -14,10 +14,16 @@
 */
 
 #include "etl_audio.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
 
+void audio::param_factory::seek(uint32_t epoch, uint32_t record)
+{
+    _dre = philox(get_global_random_seed(), epoch, record);
+}
+
 shared_ptr<audio::params> audio::param_factory::make_params(std::shared_ptr<const decoded>)
 {
     auto audio_stgs = shared_ptr<audio::params>(new audio::params());
@@ -32,9 +38,28 @@ shared_ptr<audio::params> audio::param_factory::make_params(std::shared_ptr<cons
 }
 
 /** \brief Extract audio data from a wav file using sox */
+audio::extractor::extractor(const audio::config& config)
+{
+    if(!config.decoded_cache_directory.empty()) {
+        _cache = decoded_cache::open(config.decoded_cache_directory, config.decoded_cache_max_bytes);
+        string settings = "audio";
+        _cache_seed = decoded_cache::key(settings.data(), settings.size(), 0);
+    }
+}
+
 std::shared_ptr<audio::decoded> audio::extractor::extract(const char* item, int itemSize)
 {
-    return make_shared<audio::decoded>(nervana::read_audio_from_mem(item, itemSize));
+    if(!_cache) {
+        return make_shared<audio::decoded>(nervana::read_audio_from_mem(item, itemSize));
+    }
+
+    cv::Mat samples;
+    uint64_t key = decoded_cache::key(item, itemSize, _cache_seed);
+    if(!_cache->find(key, itemSize, samples)) {
+        samples = nervana::read_audio_from_mem(item, itemSize);
+        _cache->add(key, itemSize, samples);
+    }
+    return make_shared<audio::decoded>(samples);
 }
 
 audio::transformer::transformer(const audio::config& config) :
@@ -127,7 +152,15 @@ void audio::loader::load(const vector<void*>& outbuf, shared_ptr<audio::decoded>
         padded_frames(cv::Range(nframes, _cfg.time_steps), cv::Range::all()) = cv::Scalar::all(0);
     }
 
-    cv::Mat dst(_cfg.freq_steps, _cfg.time_steps, cv_type, (void *) outbuf[0]);
-    cv::transpose(padded_frames, dst);
-    cv::flip(dst, dst, 0);
+    const output_type& otype = _cfg.get_shape_type().get_otype();
+    if (otype.is_half()) {
+        cv::Mat dst(_cfg.freq_steps, _cfg.time_steps, cv_type);
+        cv::transpose(padded_frames, dst);
+        cv::flip(dst, dst, 0);
+        half::convert(dst.ptr<float>(), dst.total(), otype, outbuf[0]);
+    } else {
+        cv::Mat dst(_cfg.freq_steps, _cfg.time_steps, cv_type, (void *) outbuf[0]);
+        cv::transpose(padded_frames, dst);
+        cv::flip(dst, dst, 0);
+    }
 }
@@ -21,8 +21,10 @@
 #include "interface.hpp"
 #include "specgram.hpp"
 #include "util.hpp"
+#include "philox.hpp"
 
 #include "noise_clips.hpp"
+#include "decoded_cache.hpp"
 
 class noise_clips;
 
@@ -112,6 +114,11 @@ public:
     /** Sample rate of input audio in hertz */
     uint32_t    sample_freq_hz   {16000};
 
+    /** If set, decoded samples are kept in a memory mapped file in this
+    * directory so later epochs skip sox. */
+    std::string decoded_cache_directory {};
+    size_t      decoded_cache_max_bytes {size_t(4) << 30};
+
     /** Simple linear time-warping */
     std::uniform_real_distribution<float>    time_scale_fraction   {1.0f, 1.0f};
 
@@ -164,7 +171,8 @@ public:
         }
 
         if (feature_type == "samples") {
-            if (output_type != "int16_t" && output_type != "float") {
+            if (output_type != "int16_t" && output_type != "float" &&
+                output_type != "float16" && output_type != "bfloat16") {
                 throw std::runtime_error("Invalid pload type for audio " + output_type);
             }
         } else {
@@ -214,6 +222,8 @@ private:
         ADD_SCALAR(noise_root, mode::OPTIONAL),
         ADD_SCALAR(add_noise_probability, mode::OPTIONAL),
         ADD_SCALAR(sample_freq_hz, mode::OPTIONAL),
+        ADD_SCALAR(decoded_cache_directory, mode::OPTIONAL),
+        ADD_SCALAR(decoded_cache_max_bytes, mode::OPTIONAL),
         ADD_DISTRIBUTION(time_scale_fraction, mode::OPTIONAL, [](decltype(time_scale_fraction) v){ return v.a() <= v.b(); }),
         // ADD_DISTRIBUTION(noise_index, mode::OPTIONAL),
         ADD_DISTRIBUTION(noise_level, mode::OPTIONAL, [](decltype(noise_level) v){ return v.a() <= v.b(); }),
@@ -246,16 +256,21 @@ private:
 class nervana::audio::param_factory : public interface::param_factory<audio::decoded, audio::params>
 {
 public:
-    param_factory(audio::config& cfg) : _cfg{cfg}
+    param_factory(audio::config& cfg) : _cfg{cfg}, _dre{get_global_random_seed()}
     {
-        _dre.seed(get_global_random_seed());
     }
     ~param_factory() {}
 
     std::shared_ptr<audio::params> make_params(std::shared_ptr<const audio::decoded> input);
+
+    // draw the params made next from the stream of position `record` in the
+    // output of epoch `epoch`, so that they depend only on the seed, the
+    // epoch and the position and not on which thread makes them or what it
+    // made before.  A shuffled record gets a different stream each epoch
+    void seek(uint32_t epoch, uint32_t record);
 private:
     audio::config& _cfg;
-    std::default_random_engine     _dre {0};
+    philox                         _dre;
 };
 
 class nervana::audio::decoded : public interface::decoded_media
@@ -276,10 +291,13 @@ class nervana::audio::extractor : public interface::extractor<audio::decoded>
 {
 public:
     extractor() {}
+    extractor(const audio::config& config);
     ~extractor() {}
 
     std::shared_ptr<audio::decoded> extract(const char*, int) override;
 private:
+    std::shared_ptr<decoded_cache> _cache;
+    uint64_t _cache_seed {0};
 };
 
 class nervana::audio::transformer : public interface::transformer<audio::decoded, audio::params>
@@ -19,6 +19,7 @@
 
 #include "interface.hpp"
 #include "util.hpp"
+#include "half.hpp"
 
 namespace nervana
 {
@@ -101,7 +102,8 @@ private:
 class nervana::blob::loader : public interface::loader<blob::decoded>
 {
 public:
-    loader(const blob::config& cfg)
+    loader(const blob::config& cfg) :
+        otype{cfg.get_shape_type().get_otype()}
     {
     }
 
@@ -109,11 +111,18 @@ public:
     {
     }
 
+    // records are copied as they are, except for half precision output
+    // which is narrowed from records of float values
     void load(const std::vector<void*>& buflist, std::shared_ptr<blob::decoded> mp) override
     {
         char* buf = (char*)buflist[0];
-        memcpy(buf, mp->data, mp->data_size);
+        if(otype.is_half()) {
+            half::convert((const float*)mp->data, mp->data_size / sizeof(float), otype, buf);
+        } else {
+            memcpy(buf, mp->data, mp->data_size);
+        }
     }
 
 private:
+    output_type otype;
 };
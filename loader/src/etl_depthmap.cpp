@@ -14,6 +14,7 @@
 */
 
 #include "etl_depthmap.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -63,23 +64,12 @@ std::shared_ptr<image::decoded> depthmap::transformer::transform(
 {
     if(image_list->get_image_count() != 1) throw invalid_argument("depthmap transform only supports a single image");
 
-    cv::Mat rotatedImage;
+    cv::Mat finalImage;
     cv::Scalar border{0,0,0};
-    image::rotate(image_list->get_image(0), rotatedImage, img_xform->angle, false, border);
+    image::rotate_crop_resize(image_list->get_image(0), finalImage, img_xform->angle, img_xform->cropbox,
+                              img_xform->output_size, img_xform->flip, false, border);
 
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size, false);
-
-    cv::Mat *finalImage = &resizedImage;
-    cv::Mat flippedImage;
-    if (img_xform->flip) {
-        cv::flip(resizedImage, flippedImage, 1);
-        finalImage = &flippedImage;
-    }
-
-    return make_shared<image::decoded>(*finalImage);
+    return make_shared<image::decoded>(finalImage);
 }
 
 void depthmap::loader::load(const std::vector<void*>& outlist, shared_ptr<image::decoded> input)
@@ -87,9 +77,11 @@ void depthmap::loader::load(const std::vector<void*>& outlist, shared_ptr<image:
     char* outbuf = (char*)outlist[0];
     // TODO: Generalize this to also handle multi_crop case
     auto img = input->get_image(0);
-    auto cv_type = _cfg.get_shape_type().get_otype().cv_type;
-    auto element_size = _cfg.get_shape_type().get_otype().size;
+    const output_type& otype = _cfg.get_shape_type().get_otype();
+    auto cv_type = otype.cv_type;
+    auto element_size = otype.size;
     int image_size = img.channels() * img.total() * element_size;
+    vector<float> half_buffer;
 
     for (int i=0; i < input->get_image_count(); i++) {
         auto outbuf_i = outbuf + (i * image_size);
@@ -98,20 +90,33 @@ void depthmap::loader::load(const std::vector<void*>& outlist, shared_ptr<image:
         vector<cv::Mat> target;
         vector<int>     from_to;
 
+        // half precision output is made as float and narrowed at the end
+        char*  dest         = outbuf_i;
+        size_t dest_element = element_size;
+        if (otype.is_half()) {
+            half_buffer.resize(img.total() * _cfg.channels);
+            dest         = (char*)half_buffer.data();
+            dest_element = sizeof(float);
+        }
+
         source.push_back(img);
         if (_cfg.channel_major) {
             for(int ch=0; ch<_cfg.channels; ch++) {
-                target.emplace_back(img.size(), cv_type, (char*)(outbuf_i + ch * img.total() * element_size));
+                target.emplace_back(img.size(), cv_type, (char*)(dest + ch * img.total() * dest_element));
                 from_to.push_back(ch);
                 from_to.push_back(ch);
             }
         } else {
-            target.emplace_back(img.size(), CV_MAKETYPE(cv_type, _cfg.channels), (char*)(outbuf_i));
+            target.emplace_back(img.size(), CV_MAKETYPE(cv_type, _cfg.channels), (char*)(dest));
             for(int ch=0; ch<_cfg.channels; ch++) {
                 from_to.push_back(ch);
                 from_to.push_back(ch);
             }
         }
         image::convert_mix_channels(source, target, from_to);
+
+        if (otype.is_half()) {
+            half::convert(half_buffer.data(), half_buffer.size(), otype, outbuf_i);
+        }
     }
 }
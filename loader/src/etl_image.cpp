@@ -13,11 +13,65 @@
  limitations under the License.
 */
 
+#include <thread>
+
 #include "etl_image.hpp"
+#include "jpeg.hpp"
+#include "crop_resize.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
 
+namespace
+{
+    // the largest libjpeg scale denominator that keeps at least `limit` source
+    // pixels per output pixel
+    int largest_scale_denom(float limit)
+    {
+        int denom = 8;
+        while(denom > 1 && denom > limit) {
+            denom /= 2;
+        }
+        return denom;
+    }
+
+    // size of the cropbox param_factory makes for an image of `in_size`
+    cv::Size2f scaled_cropbox_size(const image::config& cfg, const cv::Size2f& in_size,
+                            float scale, float horizontal_distortion)
+    {
+        cv::Size2f out_shape(cfg.width * horizontal_distortion, cfg.height);
+
+        cv::Size2f cropbox_size = image::cropbox_max_proportional(in_size, out_shape);
+        if(cfg.do_area_scale) {
+            cropbox_size = image::cropbox_area_scale(in_size, cropbox_size, scale);
+        } else {
+            cropbox_size = image::cropbox_linear_scale(cropbox_size, scale);
+        }
+        return cropbox_size;
+    }
+
+    // `cropbox` of the source image in the pixels of `image`, which covers
+    // `source_roi` of the source image, possibly at reduced resolution
+    cv::Rect decoded_cropbox(const cv::Rect& cropbox, const cv::Mat& image, const cv::Rect& source_roi)
+    {
+        if(image.size() == source_roi.size() && source_roi.x == 0 && source_roi.y == 0) {
+            return cropbox;
+        }
+        float x_scale = (float)image.cols / source_roi.width;
+        float y_scale = (float)image.rows / source_roi.height;
+        cv::Point2i tl(lround((cropbox.x - source_roi.x) * x_scale),
+                       lround((cropbox.y - source_roi.y) * y_scale));
+        cv::Point2i br(lround((cropbox.br().x - source_roi.x) * x_scale),
+                       lround((cropbox.br().y - source_roi.y) * y_scale));
+        tl.x = min(max(tl.x, 0), image.cols - 1);
+        tl.y = min(max(tl.y, 0), image.rows - 1);
+        br.x = min(max(br.x, tl.x + 1), image.cols);
+        br.y = min(max(br.y, tl.y + 1), image.rows);
+        return cv::Rect(tl, cv::Size2i(br.x - tl.x, br.y - tl.y));
+    }
+}
+
 image::config::config(nlohmann::json js)
 {
     if(js.is_null()) {
@@ -60,6 +114,45 @@ void image::config::validate()
     if(height <= 0) {
         throw std::invalid_argument("invalid height");
     }
+    if(fixed_aspect_ratio && nervana::output_type(output_type).is_half()) {
+        throw std::invalid_argument("fixed_aspect_ratio does not support half precision output");
+    }
+    if(fixed_aspect_ratio && batch_convert) {
+        throw std::invalid_argument("batch_convert is not supported with fixed_aspect_ratio");
+    }
+    if(batch_convert && !image::supports_type(nervana::output_type(output_type).cv_type)) {
+        throw std::invalid_argument("batch_convert does not support output_type " + output_type);
+    }
+    if(mean.size() > 0 || std.size() > 0 || pixel_scale != 1.0) {
+        if(output_type != "float" && output_type != "float16" && output_type != "bfloat16") {
+            throw std::invalid_argument("mean, std and pixel_scale require output_type float, float16 or bfloat16");
+        }
+        if(fixed_aspect_ratio) {
+            throw std::invalid_argument("mean, std and pixel_scale are not supported with fixed_aspect_ratio");
+        }
+        if((mean.size() > 0 && mean.size() != channels) || (std.size() > 0 && std.size() != channels)) {
+            throw std::invalid_argument("mean and std must have one value per channel");
+        }
+        for(float s : std) {
+            if(s == 0) {
+                throw std::invalid_argument("std must not be zero");
+            }
+        }
+    }
+}
+
+bool image::config::deterministic() const
+{
+    return flip_distribution.p() == 0 &&
+           crop_offset.a() == crop_offset.b() &&
+           scale.a() == scale.b() &&
+           angle.a() == angle.b() &&
+           lighting.stddev() == 0 &&
+           horizontal_distortion.a() == horizontal_distortion.b() &&
+           contrast.a() == contrast.b() &&
+           brightness.a() == brightness.b() &&
+           saturation.a() == saturation.b() &&
+           hue.a() == hue.b();
 }
 
 void image::params::dump(ostream& ostr)
@@ -79,7 +172,10 @@ void image::params::dump(ostream& ostr)
 
 
 /* Extract */
-image::extractor::extractor(const image::config& cfg)
+image::extractor::extractor(const image::config& cfg) :
+    _cfg(cfg),
+    _resize_short_side(cfg.resize_short_side),
+    _cache_seed(0)
 {
     if (!(cfg.channels == 1 || cfg.channels == 3))
     {
@@ -90,19 +186,138 @@ image::extractor::extractor(const image::config& cfg)
         _pixel_type = CV_MAKETYPE(CV_8U, cfg.channels);
         _color_mode = cfg.channels == 1 ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR;
     }
+
+    if(!cfg.decoded_cache_directory.empty()) {
+        _cache = decoded_cache::open(cfg.decoded_cache_directory, cfg.decoded_cache_max_bytes);
+        // the same file decoded with other settings must get another key
+        string settings = "image " + to_string(cfg.channels) + " " + to_string(cfg.resize_short_side);
+        _cache_seed = decoded_cache::key(settings.data(), settings.size(), 0);
+    }
+}
+
+int image::extractor::decode_scale_denom(const cv::Size2i& image_size) const
+{
+    // source pixels per output pixel along the tighter direction of the
+    // smallest region that is resized to the output size
+    float limit;
+    cv::Size2f in_size = image_size;
+    if(_resize_short_side > 0) {
+        // params are made for the image after the short side resize
+        limit = min(in_size.width, in_size.height) / _resize_short_side;
+    } else if(!_cfg.crop_enable) {
+        float image_scale;
+        if(_cfg.fixed_scaling_factor > 0) {
+            image_scale = _cfg.fixed_scaling_factor;
+        } else {
+            image_scale = image::calculate_scale(image_size, _cfg.width, _cfg.height);
+        }
+        limit = 1.0 / image_scale;
+    } else {
+        // the cropbox shrinks with scale, its width grows and its height
+        // shrinks with horizontal_distortion
+        float scale = _cfg.scale.a();
+        cv::Size2f narrowest = scaled_cropbox_size(_cfg, in_size, scale, _cfg.horizontal_distortion.a());
+        cv::Size2f lowest    = scaled_cropbox_size(_cfg, in_size, scale, _cfg.horizontal_distortion.b());
+        limit = min(narrowest.width / _cfg.width, lowest.height / _cfg.height);
+    }
+    return largest_scale_denom(limit);
+}
+
+int image::extractor::decode_scale_denom(const cv::Size2i& cropbox_size, const cv::Size2i& output_size) const
+{
+    return largest_scale_denom(min((float)cropbox_size.width / output_size.width,
+                           (float)cropbox_size.height / output_size.height));
 }
 
 shared_ptr<image::decoded> image::extractor::extract(const char* inbuf, int insize)
 {
     cv::Mat output_img;
 
-    // It is bad to cast away const, but opencv does not support a const Mat
-    // The Mat is only used for imdecode on the next line so it is OK here
-    cv::Mat input_img(1, insize, _pixel_type, const_cast<char*>(inbuf));
-    cv::imdecode(input_img, _color_mode, &output_img);
+    cv::Size2i source_size;
+    int scale_denom = 1;
+    if(_cfg.jpeg_scaled_decode && jpeg::scaled_decode_supported() &&
+       jpeg::read_size(inbuf, insize, source_size)) {
+        scale_denom = decode_scale_denom(source_size);
+    }
+
+    uint64_t key = 0;
+    bool cached = false;
+    if(_cache) {
+        key = decoded_cache::key(inbuf, insize, _cache_seed + scale_denom);
+        cached = _cache->find(key, insize, output_img);
+    }
+
+    if(!cached) {
+        if(scale_denom > 1) {
+            output_img = jpeg::decode(inbuf, insize, get_channel_count(), scale_denom);
+        }
+        if(output_img.empty()) {
+            // It is bad to cast away const, but opencv does not support a const Mat
+            // The Mat is only used for imdecode on the next line so it is OK here
+            cv::Mat input_img(1, insize, _pixel_type, const_cast<char*>(inbuf));
+            cv::imdecode(input_img, _color_mode, &output_img);
+        }
+
+        if(_resize_short_side > 0 && !output_img.empty()) {
+            float scale = (float)_resize_short_side / min(output_img.rows, output_img.cols);
+            cv::Size2i size(lround(output_img.cols * scale), lround(output_img.rows * scale));
+            cv::Mat resized;
+            image::resize(output_img, resized, size);
+            output_img = resized;
+        }
+
+        if(_cache && !output_img.empty()) {
+            _cache->add(key, insize, output_img);
+        }
+    }
 
     auto rc = make_shared<image::decoded>();
     rc->add(output_img);    // don't need to check return for single image
+    if(scale_denom > 1 && _resize_short_side == 0 && !output_img.empty()) {
+        rc->set_source_size(source_size);
+    }
+    return rc;
+}
+
+shared_ptr<image::decoded> image::extractor::extract(const char* inbuf, int insize,
+                                                     image::param_factory& factory,
+                                                     shared_ptr<image::params>& params)
+{
+    // cached images and images resized right after decoding are always
+    // decoded in full
+    cv::Size2i source_size;
+    if(!_cfg.jpeg_roi_decode || !jpeg::scaled_decode_supported() || _cache || _resize_short_side > 0 ||
+       !jpeg::read_size(inbuf, insize, source_size)) {
+        auto rc = extract(inbuf, insize);
+        params = factory.make_params(rc);
+        return rc;
+    }
+
+    // param_factory only needs the size of the image
+    auto header = make_shared<image::decoded>();
+    header->set_source_size(source_size);
+    params = factory.make_params(header);
+
+    int denom = 1;
+    if(_cfg.jpeg_scaled_decode) {
+        denom = decode_scale_denom(params->cropbox.size(), params->output_size);
+    }
+    cv::Rect roi = params->cropbox;
+    if(params->angle != 0) {
+        // the image is rotated about its center before it is cropped
+        roi = cv::Rect(cv::Point(), source_size);
+    }
+
+    cv::Rect decoded_roi;
+    cv::Mat output_img = jpeg::decode(inbuf, insize, get_channel_count(), denom, roi, decoded_roi);
+    if(output_img.empty()) {
+        // left to cv::imdecode, params are made for the same size
+        return extract(inbuf, insize);
+    }
+
+    auto rc = make_shared<image::decoded>(output_img);
+    rc->set_source_size(source_size);
+    rc->set_source_roi(decoded_roi);
     return rc;
 }
 
@@ -132,7 +347,7 @@ shared_ptr<image::decoded> image::transformer::transform(
 {
     vector<cv::Mat> finalImageList;
     for(int i=0; i<img->get_image_count(); i++) {
-        finalImageList.push_back(transform_single_image(img_xform, img->get_image(i)));
+        finalImageList.push_back(transform_single_image(img_xform, img->get_image(i), img->get_source_roi()));
     }
 
     auto rc = make_shared<image::decoded>();
@@ -146,22 +361,31 @@ cv::Mat image::transformer::transform_single_image(
                                             shared_ptr<image::params> img_xform,
                                             cv::Mat& single_img)
 {
-    cv::Mat rotatedImage;
-    image::rotate(single_img, rotatedImage, img_xform->angle);
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size);
-    photo.cbsjitter(resizedImage, img_xform->contrast, img_xform->brightness, img_xform->saturation, img_xform->hue);
-    photo.lighting(resizedImage, img_xform->lighting, img_xform->color_noise_std);
-
-    cv::Mat *finalImage = &resizedImage;
-    cv::Mat flippedImage;
-    if (img_xform->flip) {
-        cv::flip(resizedImage, flippedImage, 1);
-        finalImage = &flippedImage;
-    }
-    return *finalImage;
+    return transform_single_image(img_xform, single_img, cv::Rect(cv::Point(), single_img.size()));
+}
+
+cv::Mat image::transformer::transform_single_image(
+                                            shared_ptr<image::params> img_xform,
+                                            cv::Mat& single_img,
+                                            const cv::Rect& source_roi)
+{
+    cv::Rect cropbox = decoded_cropbox(img_xform->cropbox, single_img, source_roi);
+
+    // the photometric distortions treat every pixel the same, so flipping
+    // before them gives the same image
+    cv::Mat finalImage;
+    image::rotate_crop_resize(single_img, finalImage, img_xform->angle, cropbox,
+                              img_xform->output_size, img_xform->flip);
+    photo.apply(finalImage, img_xform->contrast, img_xform->brightness, img_xform->saturation, img_xform->hue,
+                img_xform->lighting, img_xform->color_noise_std);
+    return finalImage;
+}
+
+void image::param_factory::seek(uint32_t epoch, uint32_t record)
+{
+    _dre = philox(get_global_random_seed(), epoch, record);
+    // normal_distribution keeps the second value of each pair it generates
+    _cfg.lighting.reset();
 }
 
 shared_ptr<image::params>
@@ -179,7 +403,7 @@ image::param_factory::make_params(shared_ptr<const decoded> input)
 
     if(!_cfg.crop_enable)
     {
-        cv::Size2f size = input->get_image_size();
+        cv::Size2f size = input->get_source_size();
         settings->cropbox = cv::Rect(cv::Point2f(0,0), size);
         float image_scale;
         if(_cfg.fixed_scaling_factor > 0) {
@@ -194,18 +418,13 @@ image::param_factory::make_params(shared_ptr<const decoded> input)
     }
     else
     {
-        cv::Size2f in_size = input->get_image_size();
+        // cropboxes are in source image coordinates, also when the image was
+        // decoded at reduced resolution
+        cv::Size2f in_size = input->get_source_size();
 
         float scale = _cfg.scale(_dre);
         float horizontal_distortion = _cfg.horizontal_distortion(_dre);
-        cv::Size2f out_shape(_cfg.width * horizontal_distortion, _cfg.height);
-
-        cv::Size2f cropbox_size = image::cropbox_max_proportional(in_size, out_shape);
-        if(_cfg.do_area_scale) {
-            cropbox_size = image::cropbox_area_scale(in_size, cropbox_size, scale);
-        } else {
-            cropbox_size = image::cropbox_linear_scale(cropbox_size, scale);
-        }
+        cv::Size2f cropbox_size = scaled_cropbox_size(_cfg, in_size, scale, horizontal_distortion);
 
         float c_off_x = _cfg.crop_offset(_dre);
         float c_off_y = _cfg.crop_offset(_dre);
@@ -227,17 +446,29 @@ image::param_factory::make_params(shared_ptr<const decoded> input)
 image::loader::loader(const image::config& cfg) :
     channel_major{cfg.channel_major},
     fixed_aspect_ratio{cfg.fixed_aspect_ratio},
+    fused{cfg.fused_load},
+    batch{cfg.batch_convert},
     stype{cfg.get_shape_type()},
-    channels{cfg.channels}
+    channels{cfg.channels},
+    output_size{(int)cfg.width, (int)cfg.height}
 {
+    if(cfg.mean.size() > 0 || cfg.std.size() > 0 || cfg.pixel_scale != 1.0) {
+        for(uint32_t c=0; c<channels; c++) {
+            float m = cfg.mean.size() > 0 ? cfg.mean[c] : 0;
+            float s = cfg.std.size() > 0 ? cfg.std[c] : 1;
+            channel_scale.push_back(cfg.pixel_scale / s);
+            channel_offset.push_back(-m / s);
+        }
+    }
 }
 
 void image::loader::load(const std::vector<void*>& outlist, shared_ptr<image::decoded> input)
 {
     char* outbuf = (char*)outlist[0];
     // TODO: Generalize this to also handle multi_crop case
-    auto cv_type = stype.get_otype().cv_type;
-    auto element_size = stype.get_otype().size;
+    const output_type& otype = stype.get_otype();
+    auto cv_type = otype.cv_type;
+    auto element_size = otype.size;
     auto img = input->get_image(0);
     int image_size = img.channels() * img.total() * element_size;
 
@@ -249,7 +480,17 @@ void image::loader::load(const std::vector<void*>& outlist, shared_ptr<image::de
         vector<cv::Mat> target;
         vector<int>     from_to;
 
-        if (fixed_aspect_ratio)
+        if (batch)
+        {
+            // stored as 8 bit HWC here, post_process() converts the batch
+            affirm(input_image.depth() == CV_8U, "batch_convert requires 8 bit images");
+            size_t row_size = input_image.cols * channels;
+            for(int row=0; row<input_image.rows; row++)
+            {
+                memcpy(outbuf_i + row * row_size, input_image.ptr(row), row_size);
+            }
+        }
+        else if (fixed_aspect_ratio)
         {
             // zero out the output buffer as the image may not fill the canvas
             for(int i=0; i<stype.get_byte_size(); i++) outbuf[i] = 0;
@@ -284,27 +525,129 @@ void image::loader::load(const std::vector<void*>& outlist, shared_ptr<image::de
         }
         else
         {
-            // methods for image
-            source.push_back(input_image);
-            if (channel_major)
+            // half precision output is made as float and narrowed at the end
+            char*  dest         = outbuf_i;
+            size_t dest_element = element_size;
+            if (otype.is_half())
             {
-                for(int ch=0; ch<channels; ch++)
-                {
-                    target.emplace_back(img.size(), cv_type, (char*)(outbuf_i + ch * img.total() * element_size));
-                    from_to.push_back(ch);
-                    from_to.push_back(ch);
-                }
+                half_buffer.resize(input_image.total() * channels);
+                dest         = (char*)half_buffer.data();
+                dest_element = sizeof(float);
+            }
+
+            if (channel_scale.size() > 0 && input_image.depth() == CV_8U)
+            {
+                image::convert(input_image, channel_major, CV_32F, dest,
+                               channel_scale.data(), channel_offset.data());
             }
             else
             {
-                target.emplace_back(input_image.size(), CV_MAKETYPE(cv_type, channels), (char*)(outbuf_i));
-                for(int ch=0; ch<channels; ch++)
+                // methods for image
+                source.push_back(input_image);
+                if (channel_major)
+                {
+                    for(int ch=0; ch<channels; ch++)
+                    {
+                        target.emplace_back(img.size(), cv_type, (char*)(dest + ch * img.total() * dest_element));
+                        from_to.push_back(ch);
+                        from_to.push_back(ch);
+                    }
+                }
+                else
                 {
-                    from_to.push_back(ch);
-                    from_to.push_back(ch);
+                    target.emplace_back(input_image.size(), CV_MAKETYPE(cv_type, channels), (char*)(dest));
+                    for(int ch=0; ch<channels; ch++)
+                    {
+                        from_to.push_back(ch);
+                        from_to.push_back(ch);
+                    }
+                }
+                image::convert_mix_channels(source, target, from_to);
+
+                if (channel_scale.size() > 0)
+                {
+                    float* out = (float*)dest;
+                    for(size_t i=0; i<input_image.total() * channels; i++)
+                    {
+                        int ch = channel_major ? i / input_image.total() : i % channels;
+                        out[i] = out[i] * channel_scale[ch] + channel_offset[ch];
+                    }
                 }
             }
-            image::convert_mix_channels(source, target, from_to);
+
+            if (otype.is_half())
+            {
+                half::convert(half_buffer.data(), half_buffer.size(), otype, outbuf_i);
+            }
         }
     }
-}
\ No newline at end of file
+}
+
+bool image::loader::fused_load(const std::vector<void*>& outlist, shared_ptr<image::decoded> input,
+                               shared_ptr<image::params> params)
+{
+    if(!fused || fixed_aspect_ratio || input->get_image_count() != 1 ||
+       params->angle != 0 || params->lighting.size() > 0 || params->contrast != 1.0 ||
+       params->brightness != 1.0 || params->saturation != 1.0 || params->hue != 0) {
+        return false;
+    }
+    cv::Mat& img = input->get_image(0);
+    cv::Rect cropbox = decoded_cropbox(params->cropbox, img, input->get_source_roi());
+    if(batch) {
+        return image::crop_resize(img, cropbox, params->output_size, params->flip,
+                                  false, CV_8U, outlist[0]);
+    }
+    const output_type& otype = stype.get_otype();
+    void* output = outlist[0];
+    if(otype.is_half()) {
+        half_buffer.resize(stype.get_element_count());
+        output = half_buffer.data();
+    }
+    if(!image::crop_resize(img, cropbox, params->output_size, params->flip,
+                           channel_major, otype.cv_type, output,
+                           channel_scale.size() > 0 ? channel_scale.data() : nullptr,
+                           channel_offset.size() > 0 ? channel_offset.data() : nullptr)) {
+        return false;
+    }
+    if(otype.is_half()) {
+        half::convert(half_buffer.data(), half_buffer.size(), otype, outlist[0]);
+    }
+    return true;
+}
+
+void image::loader::post_process(buffer_out& buffer)
+{
+    if(!batch) {
+        return;
+    }
+    const output_type& otype = stype.get_otype();
+    size_t item_count  = buffer.get_item_count();
+    size_t staged_size = output_size.area() * channels;
+
+    // each thread takes a contiguous range of items.  An item is copied out
+    // of its slot before it is converted into it, which keeps the source of
+    // the conversion in cache
+    if(!workers) {
+        workers.reset(new worker_pool(max<int>(1, thread::hardware_concurrency()) - 1));
+    }
+    size_t range_count = min<size_t>(workers->size(), item_count);
+    size_t per_range   = range_count > 0 ? (item_count + range_count - 1) / range_count : 0;
+    workers->run(range_count, [&](size_t range) {
+        vector<uint8_t> staged(staged_size);
+        vector<float>   wide(otype.is_half() ? staged_size : 0);
+        size_t end = min((range + 1) * per_range, item_count);
+        for(size_t i=range * per_range; i<end; i++) {
+            char* item = buffer.get_item(i);
+            memcpy(staged.data(), item, staged_size);
+            cv::Mat hwc(output_size, CV_8UC(channels), staged.data());
+            void* output = otype.is_half() ? (void*)wide.data() : (void*)item;
+            bool converted = image::convert(hwc, channel_major, otype.cv_type, output,
+                                            channel_scale.size() > 0 ? channel_scale.data() : nullptr,
+                                            channel_offset.size() > 0 ? channel_offset.data() : nullptr);
+            affirm(converted, "batch_convert does not support output type " + otype.tp_name);
+            if(otype.is_half()) {
+                half::convert(wide.data(), wide.size(), otype, item);
+            }
+        }
+    });
+}
@@ -22,6 +22,10 @@
 #include "interface.hpp"
 #include "image.hpp"
 #include "util.hpp"
+#include "philox.hpp"
+#include "decoded_cache.hpp"
+#include "buffer_out.hpp"
+#include "worker_pool.hpp"
 
 namespace nervana
 {
@@ -90,6 +94,43 @@ public:
     uint32_t                              channels = 3;
     float                                 fixed_scaling_factor = -1;
 
+    /** Resize decoded images so the shorter side has this length, before any
+     *  augmentation.  0 keeps the decoded size. */
+    uint32_t                              resize_short_side = 0;
+
+    /** If set, decoded (and pre-resized) images are kept in a memory mapped
+     *  file in this directory so later epochs skip decoding. */
+    std::string                           decoded_cache_directory = "";
+    size_t                                decoded_cache_max_bytes = size_t(4) << 30;
+
+    /** Decode JPEGs at 1/2, 1/4 or 1/8 resolution when even the smallest
+     *  crop that can be sampled keeps at least the output resolution. */
+    bool                                  jpeg_scaled_decode = true;
+
+    /** Make params from the JPEG header and decode only the part of the
+     *  image the cropbox covers. */
+    bool                                  jpeg_roi_decode = true;
+
+    /** Crop, resize and flip images straight into the output buffer in one
+     *  pass when no rotation or photometric distortion was sampled. */
+    bool                                  fused_load = true;
+
+    /** If set and deterministic(), the loaded output of each record is kept
+     *  in a memory mapped file in this directory and copied from there in
+     *  later epochs. */
+    std::string                           output_cache_directory = "";
+    size_t                                output_cache_max_bytes = size_t(4) << 30;
+
+    /** Store 8 bit HWC images while decoding and convert the whole batch
+     *  to output_type and layout afterwards, split across threads. */
+    bool                                  batch_convert = false;
+
+    /** Load float output as (v * pixel_scale - mean[c]) / std[c] for pixel
+     *  value v of channel c.  Either of mean and std may be left empty. */
+    std::vector<float>                    mean;
+    std::vector<float>                    std;
+    float                                 pixel_scale = 1.0;
+
     /** Scale the crop box (width, height) */
     std::uniform_real_distribution<float> scale{1.0f, 1.0f};
 
@@ -122,6 +163,9 @@ public:
 
     config(nlohmann::json js);
 
+    // true if every record gets the same params in every epoch
+    bool deterministic() const;
+
 private:
     std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
         ADD_SCALAR(height, mode::REQUIRED),
@@ -141,6 +185,18 @@ private:
         ADD_SCALAR(crop_enable, mode::OPTIONAL),
         ADD_SCALAR(fixed_aspect_ratio, mode::OPTIONAL),
         ADD_SCALAR(fixed_scaling_factor, mode::OPTIONAL),
+        ADD_SCALAR(resize_short_side, mode::OPTIONAL),
+        ADD_SCALAR(decoded_cache_directory, mode::OPTIONAL),
+        ADD_SCALAR(decoded_cache_max_bytes, mode::OPTIONAL),
+        ADD_SCALAR(jpeg_scaled_decode, mode::OPTIONAL),
+        ADD_SCALAR(jpeg_roi_decode, mode::OPTIONAL),
+        ADD_SCALAR(fused_load, mode::OPTIONAL),
+        ADD_SCALAR(output_cache_directory, mode::OPTIONAL),
+        ADD_SCALAR(output_cache_max_bytes, mode::OPTIONAL),
+        ADD_SCALAR(batch_convert, mode::OPTIONAL),
+        ADD_SCALAR(mean, mode::OPTIONAL),
+        ADD_SCALAR(std, mode::OPTIONAL),
+        ADD_SCALAR(pixel_scale, mode::OPTIONAL),
         ADD_DISTRIBUTION(contrast, mode::OPTIONAL, [](decltype(contrast) v){ return v.a() <= v.b(); }),
         ADD_DISTRIBUTION(brightness, mode::OPTIONAL, [](decltype(brightness) v){ return v.a() <= v.b(); }),
         ADD_DISTRIBUTION(saturation, mode::OPTIONAL, [](decltype(saturation) v){ return v.a() <= v.b(); }),
@@ -157,17 +213,22 @@ private:
 class nervana::image::param_factory : public interface::param_factory<image::decoded, image::params>
 {
 public:
-    param_factory(image::config& cfg) : _cfg{cfg}, _dre{0}
+    param_factory(image::config& cfg) : _cfg{cfg}, _dre{get_global_random_seed()}
     {
-        _dre.seed(get_global_random_seed());
     }
     virtual ~param_factory() {}
 
     std::shared_ptr<image::params> make_params(std::shared_ptr<const image::decoded> input);
+
+    // draw the params made next from the stream of position `record` in the
+    // output of epoch `epoch`, so that they depend only on the seed, the
+    // epoch and the position and not on which thread makes them or what it
+    // made before.  A shuffled record gets a different stream each epoch
+    void seek(uint32_t epoch, uint32_t record);
 private:
 
     image::config& _cfg;
-    std::default_random_engine _dre;
+    philox _dre;
 };
 
 // ===============================================================================================
@@ -193,6 +254,20 @@ public:
 
     cv::Mat& get_image(int index) { return _images[index]; }
     cv::Size2i get_image_size() const {return _images[0].size(); }
+
+    // size of the encoded image, which params are made for.  It differs from
+    // the image size when the extractor decoded at reduced resolution
+    cv::Size2i get_source_size() const {
+        return _source_size.area() > 0 ? _source_size : get_image_size();
+    }
+    void set_source_size(const cv::Size2i& size) { _source_size = size; }
+
+    // region of the source image the images cover, all of it unless the
+    // extractor decoded only the part params need
+    cv::Rect get_source_roi() const {
+        return _source_roi.area() > 0 ? _source_roi : cv::Rect(cv::Point(), get_source_size());
+    }
+    void set_source_roi(const cv::Rect& roi) { _source_roi = roi; }
     int get_image_channels() const { return _images[0].channels(); }
     size_t get_image_count() const { return _images.size(); }
     size_t get_size() const {
@@ -207,6 +282,8 @@ protected:
         return true;
     }
     std::vector<cv::Mat> _images;
+    cv::Size2i           _source_size;
+    cv::Rect             _source_roi;
 };
 
 
@@ -218,10 +295,28 @@ public:
     ~extractor() {}
     virtual std::shared_ptr<image::decoded> extract(const char*, int) override;
 
+    // decode and make params from `factory` for it.  JPEG params are made
+    // from the header alone and only the part of the image they need is
+    // decoded, other images are decoded in full first
+    std::shared_ptr<image::decoded> extract(const char*, int, image::param_factory& factory,
+                                            std::shared_ptr<image::params>& params);
+
     const int get_channel_count() {return _color_mode == CV_LOAD_IMAGE_COLOR ? 3 : 1;}
+
+    // the libjpeg scale denominator (1, 2, 4 or 8) to decode an image of
+    // `image_size` with so that no crop param_factory can make from it needs
+    // upscaling that a full resolution decode would not have needed
+    int decode_scale_denom(const cv::Size2i& image_size) const;
+
+    // the same for a known cropbox resized to `output_size`
+    int decode_scale_denom(const cv::Size2i& cropbox_size, const cv::Size2i& output_size) const;
 private:
+    const image::config& _cfg;
     int _pixel_type;
     int _color_mode;
+    uint32_t _resize_short_side;
+    std::shared_ptr<decoded_cache> _cache;
+    uint64_t _cache_seed;
 };
 
 
@@ -235,6 +330,12 @@ public:
                                             std::shared_ptr<image::decoded>) override;
 
     cv::Mat transform_single_image(std::shared_ptr<image::params>, cv::Mat&);
+
+    // params->cropbox is given in source image coordinates, `source_roi` is
+    // the region of the source image `single_img` covers, which it may cover
+    // at reduced resolution
+    cv::Mat transform_single_image(std::shared_ptr<image::params>, cv::Mat& single_img,
+                                   const cv::Rect& source_roi);
 private:
     image::photometric photo;
 };
@@ -247,11 +348,38 @@ public:
     ~loader() {}
     virtual void load(const std::vector<void*>&, std::shared_ptr<image::decoded>) override;
 
+    // crop, resize and flip the decoded image the way image::transformer
+    // would and load it, all in one pass.  Returns false without loading
+    // anything when params need more than that, such as a rotation or
+    // photometric distortion, and the image has to go through the
+    // transformer and load() instead
+    bool fused_load(const std::vector<void*>&, std::shared_ptr<image::decoded>,
+                    std::shared_ptr<image::params>);
+
+    // with batch_convert, load() and fused_load() leave 8 bit HWC images in
+    // the buffer and this converts all of them in place once the batch is
+    // complete.  Does nothing otherwise
+    void post_process(buffer_out&);
+
 private:
     void split(cv::Mat&, char*);
 
     bool        channel_major;
     bool        fixed_aspect_ratio;
+    bool        fused;
+    bool        batch;
     shape_type  stype;
     uint32_t    channels;
+    cv::Size2i  output_size;
+
+    // per channel v * channel_scale + channel_offset applied to float
+    // output, both empty when not normalizing
+    std::vector<float> channel_scale;
+    std::vector<float> channel_offset;
+
+    // float output narrowed to float16 or bfloat16
+    std::vector<float> half_buffer;
+
+    // threads post_process() splits each batch over, started on first use
+    std::unique_ptr<worker_pool> workers;
 };
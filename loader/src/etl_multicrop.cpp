@@ -13,6 +13,8 @@
  limitations under the License.
 */
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <vector>
 
@@ -23,6 +25,43 @@ using namespace nervana;
 
 using cv::Point2f;
 
+namespace
+{
+    // the views of one crop scale, cut from a single resized copy of the
+    // image instead of resizing every crop on its own.  `cropboxes` are in
+    // source image coordinates and all the same size.  Unflipped views are
+    // ROIs of that copy, flipped ones mirror them
+    void pyramid_views(const cv::Mat& image, const cv::Rect& source_roi, const vector<cv::Rect>& cropboxes,
+                       const cv::Size2i& output_size, const vector<bool>& orientations,
+                       vector<cv::Mat>& views)
+    {
+        // source to level scale, and decoded image to level size
+        float fx = (float)output_size.width / cropboxes[0].width;
+        float fy = (float)output_size.height / cropboxes[0].height;
+        cv::Size2i level_size(max<int>(output_size.width, lround(source_roi.width * fx)),
+                              max<int>(output_size.height, lround(source_roi.height * fy)));
+        cv::Mat level;
+        image::resize(image, level, level_size);
+
+        for(const cv::Rect& cropbox : cropboxes) {
+            int x = lround((cropbox.x - source_roi.x) * fx);
+            int y = lround((cropbox.y - source_roi.y) * fy);
+            x = min(max(x, 0), level.cols - output_size.width);
+            y = min(max(y, 0), level.rows - output_size.height);
+            cv::Mat view = level(cv::Rect(cv::Point2i(x, y), output_size));
+            for(bool flip : orientations) {
+                if(flip) {
+                    cv::Mat flipped;
+                    cv::flip(view, flipped, 1);
+                    views.push_back(flipped);
+                } else {
+                    views.push_back(view);
+                }
+            }
+        }
+    }
+}
+
 multicrop::config::config(nlohmann::json js)
  : crop_config(js["crop_config"])
 {
@@ -81,7 +120,7 @@ shared_ptr<image::decoded> multicrop::transformer::transform(
                                                 shared_ptr<image::params> crop_settings,
                                                 shared_ptr<image::decoded> input)
 {
-    cv::Size2i in_size = input->get_image_size();
+    cv::Size2i in_size = input->get_source_size();
     auto cropbox_size = image::cropbox_max_proportional(in_size, crop_settings->output_size);
 
     vector<cv::Rect> cropboxes;
@@ -97,12 +136,30 @@ shared_ptr<image::decoded> multicrop::transformer::transform(
 
     auto out_imgs = make_shared<image::decoded>();
 
+    // without rotation or photometric distortion every view of a scale is a
+    // crop of the image resized once for that scale
+    if (crop_settings->angle == 0 && crop_settings->lighting.empty() &&
+        crop_settings->contrast == 1.0 && crop_settings->brightness == 1.0 &&
+        crop_settings->saturation == 1.0 && crop_settings->hue == 0) {
+        vector<cv::Mat> views;
+        size_t per_scale = _offsets.size();
+        for (size_t i=0; i<cropboxes.size(); i+=per_scale) {
+            vector<cv::Rect> scale_boxes(cropboxes.begin() + i, cropboxes.begin() + i + per_scale);
+            pyramid_views(input->get_image(0), input->get_source_roi(), scale_boxes,
+                          crop_settings->output_size, _orientations, views);
+        }
+        if (!out_imgs->add(views)) {
+            return nullptr;
+        }
+        return out_imgs;
+    }
+
     for (auto cropbox: cropboxes) {
         crop_settings->cropbox = cropbox;
         for (auto orientation: _orientations) {
             crop_settings->flip = orientation;
             bool add_ok = out_imgs->add(
-                    _crop_transformer.transform_single_image(crop_settings, input->get_image(0))
+                    _crop_transformer.transform_single_image(crop_settings, input->get_image(0), input->get_source_roi())
                 );
             if (!add_ok) {
                 return nullptr;
@@ -0,0 +1,191 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <string.h>
+
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "half.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    uint32_t float_bits(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    float bits_float(uint32_t bits)
+    {
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    const uint32_t f32_infinity = 255 << 23;
+    const uint32_t f16_overflow = (127 + 16) << 23;   // 65536, beyond the largest float16
+    const uint32_t f16_min_normal = 113 << 23;        // 2^-14
+    const uint32_t denormal_magic = 126 << 23;        // 0.5, aligns float16 denormals to the low bits
+
+    uint16_t float16_value(float f)
+    {
+        uint32_t bits = float_bits(f);
+        uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+        uint32_t rc;
+        if(bits >= f16_overflow) {
+            rc = bits > f32_infinity ? 0x7e00 : 0x7c00;
+        } else if(bits < f16_min_normal) {
+            rc = float_bits(bits_float(bits) + bits_float(denormal_magic)) - denormal_magic;
+        } else {
+            uint32_t odd = (bits >> 13) & 1;
+            rc = (bits + ((15 - 127) << 23) + 0xfff + odd) >> 13;
+        }
+        return rc | (sign >> 16);
+    }
+
+    uint16_t bfloat16_value(float f)
+    {
+        uint32_t bits = float_bits(f);
+        if((bits & 0x7fffffff) > f32_infinity) {
+            return (bits >> 16) | 0x40;
+        }
+        return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+    }
+
+#if defined(__SSE2__)
+    // pack the low 16 bits of eight 32 bit lanes, which SSE2 can only do
+    // with signed saturation
+    inline __m128i pack_u16(__m128i a, __m128i b)
+    {
+        const __m128i bias32 = _mm_set1_epi32(0x8000);
+        const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+        return _mm_xor_si128(packed, bias16);
+    }
+
+    inline __m128i select(__m128i mask, __m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    inline __m128i float16_sse2(__m128 f)
+    {
+        const __m128i one = _mm_set1_epi32(1);
+        __m128i bits = _mm_castps_si128(f);
+        __m128i sign = _mm_and_si128(bits, _mm_set1_epi32(0x80000000u));
+        bits = _mm_xor_si128(bits, sign);
+
+        __m128i special = _mm_cmpgt_epi32(bits, _mm_set1_epi32(f16_overflow - 1));
+        __m128i nan     = _mm_cmpgt_epi32(bits, _mm_set1_epi32(f32_infinity));
+        __m128i special_value = select(nan, _mm_set1_epi32(0x7e00), _mm_set1_epi32(0x7c00));
+
+        __m128i denormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(f16_min_normal));
+        __m128  magic    = _mm_castsi128_ps(_mm_set1_epi32(denormal_magic));
+        __m128i denormal_value = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), magic)),
+                                               _mm_castps_si128(magic));
+
+        __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 13), one);
+        __m128i normal_value = _mm_add_epi32(bits, _mm_set1_epi32(((15 - 127) << 23) + 0xfff));
+        normal_value = _mm_srli_epi32(_mm_add_epi32(normal_value, odd), 13);
+
+        __m128i rc = select(denormal, denormal_value, normal_value);
+        rc = select(special, special_value, rc);
+        return _mm_or_si128(rc, _mm_srli_epi32(sign, 16));
+    }
+
+    inline __m128i bfloat16_sse2(__m128 f)
+    {
+        __m128i bits = _mm_castps_si128(f);
+        __m128i abs  = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+        __m128i nan  = _mm_cmpgt_epi32(abs, _mm_set1_epi32(f32_infinity));
+        __m128i odd  = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+        __m128i rc   = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0x7fff)), odd), 16);
+        __m128i quiet = _mm_or_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x40));
+        return select(nan, quiet, rc);
+    }
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx,f16c")))
+    void float16_f16c(const float* input, size_t count, uint16_t* output)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128((__m128i*)(output + i), h);
+        }
+        for(; i<count; i++) {
+            output[i] = float16_value(input[i]);
+        }
+    }
+#endif
+}
+
+void half::float16(const float* input, size_t count, uint16_t* output)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_f16c = __builtin_cpu_supports("f16c");
+    if(has_f16c) {
+        float16_f16c(input, count, output);
+        return;
+    }
+#endif
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i + 8 <= count; i += 8) {
+        __m128i lo = float16_sse2(_mm_loadu_ps(input + i));
+        __m128i hi = float16_sse2(_mm_loadu_ps(input + i + 4));
+        _mm_storeu_si128((__m128i*)(output + i), pack_u16(lo, hi));
+    }
+#endif
+    for(; i<count; i++) {
+        output[i] = float16_value(input[i]);
+    }
+}
+
+void half::bfloat16(const float* input, size_t count, uint16_t* output)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i + 8 <= count; i += 8) {
+        __m128i lo = bfloat16_sse2(_mm_loadu_ps(input + i));
+        __m128i hi = bfloat16_sse2(_mm_loadu_ps(input + i + 4));
+        _mm_storeu_si128((__m128i*)(output + i), pack_u16(lo, hi));
+    }
+#endif
+    for(; i<count; i++) {
+        output[i] = bfloat16_value(input[i]);
+    }
+}
+
+void half::convert(const float* input, size_t count, const output_type& otype, void* output)
+{
+    if(otype.tp_name == "float16") {
+        float16(input, count, (uint16_t*)output);
+    } else if(otype.tp_name == "bfloat16") {
+        bfloat16(input, count, (uint16_t*)output);
+    } else {
+        throw std::invalid_argument("not a half precision output type: " + otype.tp_name);
+    }
+}
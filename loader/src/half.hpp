@@ -0,0 +1,45 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "typemap.hpp"
+
+/* half
+ *
+ * Narrowing of float output to the 16 bit float16 (IEEE binary16) and
+ * bfloat16 output types.  Loaders compute these types as CV_32F and convert
+ * the result with convert() as the last step, which halves the size of the
+ * output buffers handed to the framework.
+ *
+ * Both conversions round to nearest even.  float16 uses F16C when the CPU
+ * has it and an SSE2 version of the same bit arithmetic otherwise; values
+ * beyond the float16 range become infinity.
+ */
+
+namespace nervana
+{
+    namespace half
+    {
+        void float16(const float* input, size_t count, uint16_t* output);
+        void bfloat16(const float* input, size_t count, uint16_t* output);
+
+        // narrow `count` floats to the half precision type `otype`
+        void convert(const float* input, size_t count, const output_type& otype, void* output);
+    }
+}
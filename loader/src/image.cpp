@@ -38,6 +38,88 @@ void image::rotate(const cv::Mat& input, cv::Mat& output, int angle, bool interp
     }
 }
 
+void image::rotate_crop_resize(const cv::Mat& input, cv::Mat& output, int angle, const cv::Rect& cropbox,
+                               const cv::Size2i& output_size, bool flip, bool interpolate, const cv::Scalar& border)
+{
+    if (angle == 0) {
+        cv::Mat resized;
+        image::resize(input(cropbox), resized, output_size, interpolate);
+        if (flip) {
+            cv::flip(resized, output, 1);
+        } else {
+            output = resized;
+        }
+        return;
+    }
+
+    // the rotation of image::rotate, followed by moving the cropbox to the
+    // origin and scaling it to the output size.  Pixel centers map onto pixel
+    // centers the way cv::resize maps them
+    cv::Point2i pt(input.cols / 2, input.rows / 2);
+    cv::Mat rot = cv::getRotationMatrix2D(pt, angle, 1.0);
+    double x_scale = (double)output_size.width / cropbox.width;
+    double y_scale = (double)output_size.height / cropbox.height;
+    cv::Mat transform(2, 3, CV_64F);
+    for (int col=0; col<3; col++) {
+        transform.at<double>(0, col) = rot.at<double>(0, col) * x_scale;
+        transform.at<double>(1, col) = rot.at<double>(1, col) * y_scale;
+    }
+    transform.at<double>(0, 2) += (0.5 - cropbox.x) * x_scale - 0.5;
+    transform.at<double>(1, 2) += (0.5 - cropbox.y) * y_scale - 0.5;
+    if (flip) {
+        for (int col=0; col<3; col++) {
+            transform.at<double>(0, col) = -transform.at<double>(0, col);
+        }
+        transform.at<double>(0, 2) += output_size.width - 1;
+    }
+
+    // linear interpolation skips source pixels when shrinking by more than
+    // half.  JPEGs are usually decoded at a scale that keeps crops below
+    // that; anything else first has the part of the input the warp reads
+    // shrunk with area interpolation to twice the output scale
+    int flags = interpolate ? cv::INTER_LINEAR : cv::INTER_NEAREST;
+    double shrink = 2 * min(x_scale, y_scale);
+    if (interpolate && shrink < 1.0) {
+        cv::Mat inverse;
+        cv::invertAffineTransform(transform, inverse);
+        double left = input.cols, top = input.rows, right = 0, bottom = 0;
+        for (double x : {-0.5, output_size.width - 0.5}) {
+            for (double y : {-0.5, output_size.height - 0.5}) {
+                double u = inverse.at<double>(0, 0) * x + inverse.at<double>(0, 1) * y + inverse.at<double>(0, 2);
+                double v = inverse.at<double>(1, 0) * x + inverse.at<double>(1, 1) * y + inverse.at<double>(1, 2);
+                left   = min(left, u);
+                top    = min(top, v);
+                right  = max(right, u);
+                bottom = max(bottom, v);
+            }
+        }
+        cv::Rect region((int)floor(left) - 1, (int)floor(top) - 1, 0, 0);
+        region.width  = (int)ceil(right) + 2 - region.x;
+        region.height = (int)ceil(bottom) + 2 - region.y;
+        region &= cv::Rect(0, 0, input.cols, input.rows);
+        if (region.area() > 0) {
+            cv::Size2i size(max(1, (int)lround(region.width * shrink)),
+                            max(1, (int)lround(region.height * shrink)));
+            cv::Mat shrunk;
+            cv::resize(input(region), shrunk, size, 0, 0, CV_INTER_AREA);
+
+            // pixel q of shrunk is at region.tl() + (q + 0.5) * ratio - 0.5
+            // in input
+            double x_ratio = (double)region.width / size.width;
+            double y_ratio = (double)region.height / size.height;
+            for (int row=0; row<2; row++) {
+                double* t = transform.ptr<double>(row);
+                t[2] += t[0] * (region.x + 0.5 * x_ratio - 0.5) + t[1] * (region.y + 0.5 * y_ratio - 0.5);
+                t[0] *= x_ratio;
+                t[1] *= y_ratio;
+            }
+            cv::warpAffine(shrunk, output, transform, output_size, flags, cv::BORDER_CONSTANT, border);
+            return;
+        }
+    }
+    cv::warpAffine(input, output, transform, output_size, flags, cv::BORDER_CONSTANT, border);
+}
+
 void image::resize(const cv::Mat& input, cv::Mat& output, const cv::Size2i& size, bool interpolate)
 {
     if (size == input.size()) {
@@ -27,6 +27,14 @@ namespace nervana
         // These functions may be common across different transformers
         void resize(const cv::Mat&, cv::Mat&, const cv::Size2i&, bool interpolate=true);
         void rotate(const cv::Mat& input, cv::Mat& output, int angle, bool interpolate=true, const cv::Scalar& border=cv::Scalar());
+
+        // rotate like rotate(), crop `cropbox` out of the rotated image, resize
+        // it to `output_size` like resize() and mirror it left to right if
+        // `flip`.  With a rotation all of it is one cv::warpAffine that only
+        // computes the output pixels
+        void rotate_crop_resize(const cv::Mat& input, cv::Mat& output, int angle, const cv::Rect& cropbox,
+                                const cv::Size2i& output_size, bool flip, bool interpolate=true,
+                                const cv::Scalar& border=cv::Scalar());
         void convert_mix_channels(std::vector<cv::Mat>& source, std::vector<cv::Mat>& target, std::vector<int>& from_to);
 
         float calculate_scale(const cv::Size& size, int output_width, int output_height);
@@ -43,6 +51,11 @@ namespace nervana
             static void lighting(cv::Mat& inout, std::vector<float>, float color_noise_std);
             static void cbsjitter(cv::Mat& inout, float contrast, float brightness, float saturation, int hue=0);
 
+            // cbsjitter() followed by lighting() in one pass over the pixels of
+            // an 8 bit BGR image, two when contrast needs the channel means
+            static void apply(cv::Mat& inout, float contrast, float brightness, float saturation, int hue,
+                              const std::vector<float>& lighting, float color_noise_std);
+
             // These are the eigenvectors of the pixelwise covariance matrix
             static const float _CPCA[3][3];
             static const cv::Mat CPCA;
@@ -0,0 +1,287 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#ifdef HAS_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+#include "jpeg.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+#ifdef HAS_LIBJPEG
+    struct error_manager
+    {
+        jpeg_error_mgr  pub;
+        jmp_buf         jump;
+    };
+
+    void error_exit(j_common_ptr cinfo)
+    {
+        longjmp(((error_manager*)cinfo->err)->jump, 1);
+    }
+
+    void output_message(j_common_ptr)
+    {
+        // corrupt data warnings are not fatal and would only flood stderr
+    }
+
+    // libjpeg reports errors through longjmp back into this function, so the
+    // only objects changed in here after setjmp are owned by the caller.
+    // `roi` is clipped to the image, nullptr decodes all of it
+    bool decompress(jpeg_decompress_struct& cinfo, error_manager& err,
+                    int channels, int scale_denom, const cv::Rect* roi,
+                    cv::Rect& decoded_roi, cv::Mat& row_buffer, cv::Mat& image)
+    {
+        if(setjmp(err.jump)) {
+            return false;
+        }
+
+        jpeg_read_header(&cinfo, TRUE);
+        if(cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+            return false;
+        }
+
+        cinfo.scale_num   = 1;
+        cinfo.scale_denom = scale_denom;
+        if(channels == 1) {
+            cinfo.out_color_space = JCS_GRAYSCALE;
+        } else {
+#ifdef JCS_EXTENSIONS
+            cinfo.out_color_space = JCS_EXT_BGR;
+#else
+            cinfo.out_color_space = JCS_RGB;
+#endif
+        }
+
+        jpeg_start_decompress(&cinfo);
+
+        // the roi in scaled output pixels, rounded outwards
+        JDIMENSION x0    = 0;
+        JDIMENSION y0    = 0;
+        JDIMENSION width = cinfo.output_width;
+        JDIMENSION y1    = cinfo.output_height;
+        if(roi) {
+            int left   = max(roi->x, 0);
+            int top    = max(roi->y, 0);
+            int right  = min<int>(roi->br().x, cinfo.image_width);
+            int bottom = min<int>(roi->br().y, cinfo.image_height);
+            if(right <= left || bottom <= top) {
+                return false;
+            }
+            x0    = left / scale_denom;
+            y0    = top / scale_denom;
+            width = min<JDIMENSION>((right + scale_denom - 1) / scale_denom, cinfo.output_width) - x0;
+            y1    = min<JDIMENSION>((bottom + scale_denom - 1) / scale_denom, cinfo.output_height);
+        }
+
+#ifdef LIBJPEG_TURBO_VERSION_NUMBER
+        // libjpeg-turbo only runs the IDCT for the blocks inside the roi.
+        // jpeg_crop_scanline moves x0 left to a block boundary and widens
+        // width to match
+        if(width < cinfo.output_width) {
+            jpeg_crop_scanline(&cinfo, &x0, &width);
+        }
+        if(y0 > 0) {
+            jpeg_skip_scanlines(&cinfo, y0);
+        }
+        image.create(y1 - y0, width, CV_8UC(channels));
+        while(cinfo.output_scanline < y1) {
+            JSAMPROW row = image.ptr(cinfo.output_scanline - y0);
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+#else
+        // plain libjpeg decodes whole rows, the ones above the roi are dropped
+        // and decoding stops after its last row
+        image.create(y1 - y0, width, CV_8UC(channels));
+        if(width < cinfo.output_width || y0 > 0) {
+            row_buffer.create(1, cinfo.output_width, CV_8UC(channels));
+        }
+        while(cinfo.output_scanline < y1) {
+            if(row_buffer.empty()) {
+                JSAMPROW row = image.ptr(cinfo.output_scanline);
+                jpeg_read_scanlines(&cinfo, &row, 1);
+            } else {
+                JSAMPROW row = row_buffer.ptr();
+                JDIMENSION line = cinfo.output_scanline;
+                jpeg_read_scanlines(&cinfo, &row, 1);
+                if(line >= y0) {
+                    memcpy(image.ptr(line - y0), row + x0 * channels, width * channels);
+                }
+            }
+        }
+#endif
+        if(cinfo.output_scanline == cinfo.output_height) {
+            jpeg_finish_decompress(&cinfo);
+        }
+
+        // the region of the full resolution image the output covers
+        int right  = min<int>((x0 + width) * scale_denom, cinfo.image_width);
+        int bottom = min<int>(y1 * scale_denom, cinfo.image_height);
+        decoded_roi = cv::Rect(x0 * scale_denom, y0 * scale_denom,
+                               right - x0 * scale_denom, bottom - y0 * scale_denom);
+        return true;
+    }
+#endif
+
+    cv::Mat decode(const char* data, size_t size, int channels, int scale_denom,
+                   const cv::Rect* roi, cv::Rect& decoded_roi)
+    {
+        affirm(channels == 1 || channels == 3, "jpeg decode supports 1 or 3 channels");
+        affirm(scale_denom == 1 || scale_denom == 2 || scale_denom == 4 || scale_denom == 8,
+               "jpeg scale_denom must be 1, 2, 4 or 8");
+
+        cv::Mat image;
+#ifdef HAS_LIBJPEG
+        jpeg_decompress_struct cinfo;
+        error_manager err;
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = error_exit;
+        err.pub.output_message = output_message;
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, (unsigned char*)data, size);
+
+        cv::Mat row_buffer;
+        bool ok = decompress(cinfo, err, channels, scale_denom, roi, decoded_roi, row_buffer, image);
+        jpeg_destroy_decompress(&cinfo);
+        if(!ok) {
+            return cv::Mat();
+        }
+#ifndef JCS_EXTENSIONS
+        if(channels == 3) {
+            cv::cvtColor(image, image, CV_RGB2BGR);
+        }
+#endif
+#else
+        // It is bad to cast away const, but opencv does not support a const Mat
+        cv::Mat input(1, size, CV_8UC1, const_cast<char*>(data));
+        cv::imdecode(input, channels == 1 ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR, &image);
+        if(image.empty()) {
+            return image;
+        }
+        decoded_roi = cv::Rect(cv::Point(), image.size());
+        if(roi) {
+            decoded_roi &= *roi;
+            if(decoded_roi.area() <= 0) {
+                return cv::Mat();
+            }
+            image = image(decoded_roi);
+        }
+        if(scale_denom > 1) {
+            cv::Mat scaled;
+            cv::resize(image, scaled, jpeg::scaled_size(image.size(), scale_denom), 0, 0, CV_INTER_AREA);
+            image = scaled;
+        }
+#endif
+        return image;
+    }
+}
+
+bool jpeg::is_jpeg(const char* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    return size >= 3 && p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF;
+}
+
+bool jpeg::read_size(const char* data, size_t size, cv::Size2i& image_size)
+{
+    if(!is_jpeg(data, size)) {
+        return false;
+    }
+
+    const uint8_t* p = (const uint8_t*)data;
+    size_t offset = 2;
+    while(offset + 4 <= size) {
+        if(p[offset] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = p[offset + 1];
+        if(marker == 0xFF) {
+            // fill byte
+            offset++;
+            continue;
+        }
+        offset += 2;
+        if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            // TEM and RSTn have no payload
+            continue;
+        }
+        if(marker == 0xD9 || marker == 0xDA) {
+            // end of image or start of scan before any frame header
+            return false;
+        }
+
+        size_t length = p[offset] << 8 | p[offset + 1];
+        if(length < 2) {
+            return false;
+        }
+
+        // SOF0 to SOF15, except DHT, JPG and DAC which share the range
+        if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            // length (2), precision (1), height (2), width (2)
+            if(offset + 7 > size) {
+                return false;
+            }
+            int height = p[offset + 3] << 8 | p[offset + 4];
+            int width  = p[offset + 5] << 8 | p[offset + 6];
+            if(width == 0 || height == 0) {
+                return false;
+            }
+            image_size = cv::Size2i(width, height);
+            return true;
+        }
+        offset += length;
+    }
+    return false;
+}
+
+bool jpeg::scaled_decode_supported()
+{
+#ifdef HAS_LIBJPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+cv::Size2i jpeg::scaled_size(const cv::Size2i& image_size, int scale_denom)
+{
+    // libjpeg rounds the scaled dimensions up
+    return cv::Size2i((image_size.width + scale_denom - 1) / scale_denom,
+                      (image_size.height + scale_denom - 1) / scale_denom);
+}
+
+cv::Mat jpeg::decode(const char* data, size_t size, int channels, int scale_denom)
+{
+    cv::Rect decoded_roi;
+    return ::decode(data, size, channels, scale_denom, nullptr, decoded_roi);
+}
+
+cv::Mat jpeg::decode(const char* data, size_t size, int channels, int scale_denom,
+                     const cv::Rect& roi, cv::Rect& decoded_roi)
+{
+    return ::decode(data, size, channels, scale_denom, &roi, decoded_roi);
+}
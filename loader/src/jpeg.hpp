@@ -0,0 +1,64 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+/* jpeg
+ *
+ * Direct access to libjpeg for the cases cv::imdecode does not cover.  The
+ * frame header is read without decoding anything, and images can be decoded
+ * at 1/2, 1/4 or 1/8 of their resolution through libjpeg DCT scaling, which
+ * skips most of the inverse DCT work and is several times faster than a full
+ * decode followed by a resize.  A region of interest can be decoded on its
+ * own: with libjpeg-turbo only the blocks inside it go through the IDCT,
+ * plain libjpeg still decodes the rows above it but stops after its last row.
+ *
+ * Both need aeon to be built against libjpeg (HAS_LIBJPEG).  Without it
+ * decode() falls back to cv::imdecode followed by a crop and a resize.
+ */
+
+namespace nervana
+{
+    namespace jpeg
+    {
+        // true if `data` starts with a JPEG start of image marker
+        bool is_jpeg(const char* data, size_t size);
+
+        // read the image dimensions from the frame header.  returns false if
+        // `data` is not a JPEG or no frame header was found
+        bool read_size(const char* data, size_t size, cv::Size2i& image_size);
+
+        // true if decode() scales while decoding rather than after
+        bool scaled_decode_supported();
+
+        // size of an image of `image_size` decoded at 1/`scale_denom`
+        cv::Size2i scaled_size(const cv::Size2i& image_size, int scale_denom);
+
+        // decode at 1/`scale_denom` (1, 2, 4 or 8) of the full resolution into
+        // an 8 bit image with `channels` (1 or 3) channels, BGR like
+        // cv::imdecode.  returns an empty Mat for data it can not decode, such
+        // as CMYK images, so that the caller can fall back to cv::imdecode
+        cv::Mat decode(const char* data, size_t size, int channels, int scale_denom);
+
+        // decode only the part of the image that covers `roi`, given in full
+        // resolution pixels.  Whole blocks are decoded so the result may
+        // cover more than `roi`.  `decoded_roi` receives the region of the
+        // full resolution image that the returned image covers
+        cv::Mat decode(const char* data, size_t size, int channels, int scale_denom,
+                       const cv::Rect& roi, cv::Rect& decoded_roi);
+    }
+}
@@ -23,8 +23,12 @@
 
 #include "loader.hpp"
 #include "block_loader_cpio_cache.hpp"
+#include "block_loader_memory_cache.hpp"
+#include "block_loader_packed_cache.hpp"
 #include "block_iterator_sequential.hpp"
 #include "block_iterator_shuffled.hpp"
+#include "block_iterator_global_shuffle.hpp"
+#include "block_iterator_shuffle_buffer.hpp"
 #include "batch_iterator.hpp"
 #include "manifest_nds.hpp"
 #include "block_loader_nds.hpp"
@@ -35,12 +39,16 @@ using namespace nervana;
 decode_thread_pool::decode_thread_pool(int count,
                                        const shared_ptr<buffer_pool_in>& in,
                                        const shared_ptr<buffer_pool_out>& out,
-                                       const shared_ptr<python_backend>& pbe) :
+                                       const shared_ptr<python_backend>& pbe,
+                                       uint32_t record_count,
+                                       uint64_t first_batch) :
     thread_pool(count),
     _in(in),
     _out(out),
     _python_backend(pbe),
-    _batchSize(_python_backend->_batchSize)
+    _batchSize(_python_backend->_batchSize),
+    _recordCount(record_count),
+    _batchIndex(first_batch)
 {
     _itemsPerThread = (_batchSize - 1) / _count + 1;
     affirm(_itemsPerThread * count >= _batchSize, "_itemsPerThread * count >= _batchSize");
@@ -137,6 +145,8 @@ void decode_thread_pool::work(int id)
         affirm((*_inputBuf)[0]->get_item_count() != 0, "input buffer to decoded_thread_pool is empty");
 
         for (int i = _startInds[id]; i < _endInds[id]; i++) {
+            uint64_t position = _batchIndex * _batchSize + i;
+            _providers[id]->seek(position / _recordCount, position % _recordCount);
             _providers[id]->provide(i, *_inputBuf, _out->get_for_write());
         }
     } catch (std::exception& e) {
@@ -173,6 +183,7 @@ void decode_thread_pool::produce()
                 _ended.wait(lock);
             }
             _endSignaled = 0;
+            _batchIndex++;
         }
 
         try {
@@ -286,15 +297,19 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
 
         auto manifest = make_shared<nervana::manifest_nds>(lcfg.manifest_filename);
 
-        // TODO: add shard_count/shard_index to cfg
         _block_loader = make_shared<block_loader_nds>(manifest->baseurl,
                                                       manifest->token,
                                                       manifest->collection_id,
-                                                      lcfg.macrobatch_size);
+                                                      lcfg.macrobatch_size,
+                                                      lcfg.shard_count,
+                                                      lcfg.shard_index,
+                                                      lcfg.nds_concurrency,
+                                                      lcfg.nds_retries);
 
         base_manifest = manifest;
     } else {
-        // the manifest defines which data should be included in the dataset
+        // the manifest defines which data should be included in the dataset.
+        // manifest_csv also opens binary indexes, see manifest_csv::is_likely_index
         auto manifest = make_shared<nervana::manifest_csv>(lcfg.manifest_filename,
                                                            lcfg.shuffle_manifest, lcfg.manifest_root);
 
@@ -305,25 +320,52 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
 
         _block_loader = make_shared<block_loader_file>(manifest,
                                                        lcfg.subset_fraction,
-                                                       lcfg.macrobatch_size);
+                                                       lcfg.macrobatch_size,
+                                                       lcfg.shard_count,
+                                                       lcfg.shard_index);
         base_manifest = manifest;
     }
 
     if(lcfg.cache_directory.length() > 0) {
-        string cache_id = base_manifest->cache_id() + to_string(_block_loader->object_count());
-        _block_loader = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
-                                                             cache_id,
-                                                             base_manifest->version(),
-                                                             _block_loader);
+        string cache_id = base_manifest->cache_id() + lcfg.cache_id_suffix() +
+                          to_string(_block_loader->object_count());
+        if(lcfg.cache_format == "packed") {
+            affirm(lcfg.cache_max_bytes == 0, "cache_format packed can not be used with cache_max_bytes");
+            _block_loader = make_shared<block_loader_packed_cache>(lcfg.cache_directory,
+                                                                   cache_id,
+                                                                   base_manifest->version(),
+                                                                   _block_loader);
+        } else {
+            _block_loader = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
+                                                                 cache_id,
+                                                                 base_manifest->version(),
+                                                                 _block_loader,
+                                                                 lcfg.cache_max_bytes);
+        }
+    }
+
+    if(lcfg.memory_cache_max_bytes > 0) {
+        _block_loader = make_shared<block_loader_memory_cache>(_block_loader,
+                                                               lcfg.memory_cache_max_bytes);
     }
 
     shared_ptr<block_iterator> block_iter;
-    if (lcfg.shuffle_every_epoch) {
+    if (lcfg.global_shuffle) {
+        affirm(lcfg.cache_directory.length() > 0, "global_shuffle requires a cache_directory");
+        affirm(lcfg.cache_max_bytes == 0, "global_shuffle can not be used with cache_max_bytes");
+        block_iter = make_shared<block_iterator_global_shuffle>(_block_loader);
+    } else if (lcfg.shuffle_every_epoch) {
         block_iter = make_shared<block_iterator_shuffled>(_block_loader);
     } else {
         block_iter = make_shared<block_iterator_sequential>(_block_loader);
     }
 
+    if (lcfg.shuffle_buffer_blocks > 0) {
+        block_iter = make_shared<block_iterator_shuffle_buffer>(block_iter, _block_loader,
+                                                                lcfg.shuffle_buffer_blocks,
+                                                                lcfg.shuffle_buffer_size);
+    }
+
     _batch_iterator = make_shared<batch_iterator>(block_iter, lcfg.minibatch_size);
 }
 
@@ -368,7 +410,8 @@ int loader::start()
                                                        _python_backend->use_pinned_memory());
 
         _decode_thread_pool = unique_ptr<decode_thread_pool>(
-                new decode_thread_pool(nthreads, _read_buffers, _decode_buffers, _python_backend));
+                new decode_thread_pool(nthreads, _read_buffers, _decode_buffers, _python_backend,
+                                       itemCount(), _start_batch));
 
         for (auto& p: providers)
         {
@@ -409,6 +452,24 @@ int loader::reset()
 {
     stop();
     _batch_iterator->reset();
+    _start_batch = 0;
+    return start();
+}
+
+int loader::seek(int epoch, int batch)
+{
+    if(epoch < 0 || batch < 0) {
+        return -1;
+    }
+    stop();
+
+    // the python side does not reset between epochs, the minibatches simply
+    // keep coming and epoch e starts with minibatch ceil(e * N / batch size)
+    uint64_t records = itemCount();
+    _start_batch = ((uint64_t)epoch * records + _batchSize - 1) / _batchSize + batch;
+    uint64_t position = _start_batch * _batchSize;
+    _batch_iterator->seek(position / records, position % records);
+
     return start();
 }
 
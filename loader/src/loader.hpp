@@ -55,7 +55,9 @@ public:
     decode_thread_pool(int count,
                        const std::shared_ptr<nervana::buffer_pool_in>& in,
                        const std::shared_ptr<nervana::buffer_pool_out>& out,
-                       const std::shared_ptr<python_backend>& pbe);
+                       const std::shared_ptr<python_backend>& pbe,
+                       uint32_t record_count,
+                       uint64_t first_batch = 0);
 
     virtual ~decode_thread_pool();
     virtual void start() override;
@@ -81,12 +83,15 @@ private:
     std::condition_variable     _started;
     std::condition_variable     _ended;
     int                         _batchSize;
+    uint32_t                    _recordCount;
     int                         _endSignaled    = 0;
     std::thread*                _manager        = 0;
     bool                        _stopManager    = false;
     bool                        _managerStopped = false;
     nervana::buffer_in_array*   _inputBuf       = 0;
     int                         _bufferIndex    = 0;
+    // position of the current minibatch in the loader's stream
+    uint64_t                    _batchIndex;
 
     std::vector<std::shared_ptr<nervana::provider_interface>> _providers;
 
@@ -104,12 +109,22 @@ public:
 
     std::string type;
     std::string cache_directory     = "";
+    std::string cache_format        = "cpio";
+    size_t      cache_max_bytes     = 0;
+    size_t      memory_cache_max_bytes = 0;
     int         macrobatch_size     = 0;
     float       subset_fraction     = 1.0;
     bool        shuffle_every_epoch = false;
+    bool        global_shuffle      = false;
+    int         shuffle_buffer_blocks = 0;
+    int         shuffle_buffer_size = 0;
     bool        shuffle_manifest    = false;
     bool        single_thread       = false;
     int         random_seed         = 0;
+    int         shard_count         = 1;
+    int         shard_index         = 0;
+    int         nds_concurrency     = 4;
+    int         nds_retries         = 3;
 
     loader_config(nlohmann::json js)
     {
@@ -125,11 +140,24 @@ public:
         if(macrobatch_size == 0) {
             macrobatch_size = minibatch_size;
         }
+        if(shuffle_buffer_size == 0) {
+            shuffle_buffer_size = shuffle_buffer_blocks * macrobatch_size;
+        }
 
         set_global_random_seed(random_seed);
         validate();
     }
 
+    // distinguishes the caches of the shards of a dataset, which would
+    // otherwise invalidate each other
+    std::string cache_id_suffix() const
+    {
+        if(shard_count == 1) {
+            return "";
+        }
+        return "s" + std::to_string(shard_index) + "of" + std::to_string(shard_count) + "-";
+    }
+
 private:
     std::vector<std::shared_ptr<nervana::interface::config_info_interface>> config_list = {
         ADD_SCALAR(type, mode::REQUIRED),
@@ -137,16 +165,31 @@ private:
         ADD_SCALAR(manifest_root, mode::OPTIONAL),
         ADD_SCALAR(minibatch_size, mode::REQUIRED),
         ADD_SCALAR(cache_directory, mode::OPTIONAL),
+        ADD_SCALAR(cache_format, mode::OPTIONAL, [](const std::string& v){ return v == "cpio" || v == "packed"; }),
+        ADD_SCALAR(cache_max_bytes, mode::OPTIONAL),
+        ADD_SCALAR(memory_cache_max_bytes, mode::OPTIONAL),
         ADD_SCALAR(macrobatch_size, mode::OPTIONAL),
         ADD_SCALAR(subset_fraction, mode::OPTIONAL, [](decltype(subset_fraction) v){ return v <= 1.0 && v >= 0.0; }),
         ADD_SCALAR(shuffle_every_epoch, mode::OPTIONAL),
+        ADD_SCALAR(global_shuffle, mode::OPTIONAL),
+        ADD_SCALAR(shuffle_buffer_blocks, mode::OPTIONAL, [](int v){ return v >= 0; }),
+        ADD_SCALAR(shuffle_buffer_size, mode::OPTIONAL, [](int v){ return v >= 0; }),
         ADD_SCALAR(shuffle_manifest, mode::OPTIONAL),
         ADD_SCALAR(single_thread, mode::OPTIONAL),
         ADD_SCALAR(random_seed, mode::OPTIONAL),
+        ADD_SCALAR(shard_count, mode::OPTIONAL, [](int v){ return v > 0; }),
+        ADD_SCALAR(shard_index, mode::OPTIONAL, [](int v){ return v >= 0; }),
+        ADD_SCALAR(nds_concurrency, mode::OPTIONAL, [](int v){ return v > 0; }),
+        ADD_SCALAR(nds_retries, mode::OPTIONAL, [](int v){ return v >= 0; }),
     };
 
     loader_config() {}
-    bool validate() { return true; }
+    void validate()
+    {
+        if(shard_index >= shard_count) {
+            throw std::invalid_argument("shard_index must be less than shard_count");
+        }
+    }
 };
 
 /*
@@ -188,6 +231,9 @@ public:
     int start();
     void stop();
     int reset();
+    // continue at minibatch `batch` of epoch `epoch`, counting epochs the way
+    // the python DataLoader does, see doc/source/user_guide.rst
+    int seek(int epoch, int batch);
     PyObject* shapes();
     PyObject* next(int bufIdx);
 
@@ -211,6 +257,7 @@ private:
     std::shared_ptr<nervana::batch_iterator>    _batch_iterator = nullptr;
 
     int                                         _batchSize;
+    uint64_t                                    _start_batch = 0;
     nlohmann::json                              _lcfg_json;
     std::shared_ptr<python_backend>             _python_backend;
 };
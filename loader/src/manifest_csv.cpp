@@ -14,6 +14,10 @@
 */
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
 
 #include <algorithm>
 #include <iostream>
@@ -22,6 +26,8 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <limits>
+#include <thread>
 
 #include "manifest_csv.hpp"
 #include "util.hpp"
@@ -30,18 +36,36 @@
 using namespace std;
 using namespace nervana;
 
-manifest_csv::manifest_csv(const string& filename, bool shuffle, const string& root, float subset_fraction) :
-    _filename(filename)
+namespace
 {
-    // for now parse the entire manifest on creation
-    ifstream infile(_filename);
+    const char index_magic[8] = {'A', 'E', 'O', 'N', 'M', 'I', 'D', 'X'};
+    const uint32_t index_format_version = 1;
 
-    if(!infile.is_open())
+    struct index_header
     {
-        throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
-    }
+        char        magic[8];
+        uint32_t    format_version;
+        uint32_t    nelements;
+        uint64_t    record_count;
+        uint32_t    crc;
+        uint32_t    cache_id_size;
+        uint64_t    cache_id_offset;
+        uint64_t    strings_offset;
+        uint64_t    offsets_offset;
+        uint8_t     reserved[8];
+    };
+    static_assert(sizeof(index_header) == 64, "index_header must be 64 bytes");
+}
 
-    parse_stream(infile, root);
+manifest_csv::manifest_csv(const string& filename, bool shuffle, const string& root, float subset_fraction) :
+    _filename(filename),
+    _root(root)
+{
+    if(is_likely_index(_filename)) {
+        map_index();
+    } else {
+        read_csv();
+    }
 
     // If we don't need to shuffle, there may be small performance
     // benefits in some situations to stream the filename_lists instead
@@ -51,12 +75,144 @@ manifest_csv::manifest_csv(const string& filename, bool shuffle, const string& r
     // file, so a purely stream based interface is not sufficient.
     if(shuffle) {
         shuffle_filename_lists();
+        crc_computed = false;
+    }
+
+}
+
+manifest_csv::~manifest_csv()
+{
+    if(_index_map) {
+        munmap(_index_map, _index_size);
+    }
+}
+
+void manifest_csv::read_csv()
+{
+    // for now parse the entire manifest on creation
+    ifstream infile(_filename, ios::binary);
+
+    if(!infile.is_open())
+    {
+        throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
+    }
+
+    // read the whole file, with room for a '\0' after the last field
+    infile.seekg(0, ios::end);
+    _buffer.resize((size_t)infile.tellg() + 1);
+    infile.seekg(0, ios::beg);
+    infile.read(_buffer.data(), _buffer.size() - 1);
+    _buffer.back() = '\0';
+
+    parse_buffer();
+}
+
+void manifest_csv::map_index()
+{
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if(fd == -1) {
+        throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
+    }
+    _index_size = file_util::get_file_size(_filename);
+    void* data = mmap(nullptr, _index_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error("unable to map manifest index " + _filename);
+    }
+    _index_map = data;
+
+    const char* base = (const char*)data;
+    const index_header* header = (const index_header*)base;
+    if(_index_size < sizeof(index_header) ||
+       header->format_version != index_format_version ||
+       header->offsets_offset + header->record_count * sizeof(uint64_t) > _index_size ||
+       header->cache_id_offset + header->cache_id_size > _index_size) {
+        throw std::runtime_error("manifest index " + _filename + " is invalid or has an unsupported version");
+    }
+
+    _nelements = header->nelements;
+    _index_crc = header->crc;
+    _index_cache_id.assign(base + header->cache_id_offset, header->cache_id_size);
+    _strings = base + header->strings_offset;
+    _offsets = (const uint64_t*)(base + header->offsets_offset);
+    _record_count = header->record_count;
+    madvise(data, _index_size, MADV_WILLNEED);
+}
+
+void manifest_csv::set_records(vector<uint64_t>&& records)
+{
+    _records = move(records);
+    _offsets = _records.data();
+    _record_count = _records.size();
+}
+
+bool manifest_csv::is_likely_index(const std::string filename)
+{
+    // check for the magic number at the start of a binary index, anything
+    // else is parsed as csv
+    ifstream f(filename, ios::binary);
+    char magic[sizeof(index_magic)];
+    f.read(magic, sizeof(magic));
+    return f && memcmp(magic, index_magic, sizeof(magic)) == 0;
+}
+
+void manifest_csv::write_index(const string& filename)
+{
+    index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.format_version = index_format_version;
+    header.nelements = _nelements;
+    header.record_count = _record_count;
+    header.crc = get_crc();
+
+    // the crc, and with it the version, only matches what the records give
+    // when they are read back without a root
+    affirm(_root.empty(), "manifest index must be written without a manifest root");
+
+    string id = cache_id();
+    header.cache_id_size = id.size();
+    header.cache_id_offset = sizeof(header);
+    header.strings_offset = header.cache_id_offset + id.size();
+
+    // the fields of each record back to back, with the offset of each record
+    // relative to the string table
+    vector<char> strings;
+    vector<uint64_t> offsets(_record_count);
+    for(size_t r=0; r<_record_count; r++) {
+        offsets[r] = strings.size();
+        const char* field = _strings + _offsets[r];
+        for(uint32_t i=0; i<_nelements; i++) {
+            size_t length = strlen(field);
+            strings.insert(strings.end(), field, field + length + 1);
+            field += length + 1;
+        }
     }
+    // keep the offset table 8 byte aligned in the mapped file
+    size_t end = header.strings_offset + strings.size();
+    strings.resize(strings.size() + (8 - end % 8) % 8, '\0');
+    header.offsets_offset = header.strings_offset + strings.size();
 
+    string tmp_filename = filename + ".tmp";
+    ofstream f(tmp_filename, ios::binary);
+    f.write((const char*)&header, sizeof(header));
+    f.write(id.data(), id.size());
+    f.write(strings.data(), strings.size());
+    f.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+    f.close();
+    if(!f || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        remove(tmp_filename.c_str());
+        throw std::runtime_error("unable to write manifest index " + filename);
+    }
 }
 
 string manifest_csv::cache_id()
 {
+    if(_index_map) {
+        // the cache id of the csv file the index was built from
+        return _index_cache_id;
+    }
+
     // returns a hash of the _filename
     std::size_t h = std::hash<std::string>()(_filename);
     stringstream ss;
@@ -71,58 +227,208 @@ string manifest_csv::version()
     return ss.str();
 }
 
-void manifest_csv::parse_stream(istream& is, const string& root)
+namespace
 {
-    // parse istream is and load the entire thing into _filename_lists
-    uint32_t prev_num_fields = 0, lineno = 0;
-    string line;
+    // manifests smaller than this per thread are parsed on fewer threads
+    const size_t min_bytes_per_thread = 4 * 1024 * 1024;
 
-    // read in each line, then from that istringstream, break into
-    // comma-separated fields.
-    while(std::getline(is, line)) {
+    int parse_thread_count(size_t bytes)
+    {
+        size_t rc = min<size_t>(thread::hardware_concurrency(), bytes / min_bytes_per_thread);
+        return max<size_t>(rc, 1);
+    }
+}
 
-        if (line.empty() || line[0] == '#')  //Skip comments and empty lines
-        {
-            continue;
-        }
+struct manifest_csv::parse_chunk
+{
+    size_t              begin;
+    size_t              end;
+    vector<uint64_t>    records;
+    uint32_t            first_num_fields = 0;
+    // index of the first record whose field count differs from the first
+    size_t              bad_record       = numeric_limits<size_t>::max();
+    uint32_t            bad_num_fields   = 0;
+    uint32_t            crc              = 0;
+    size_t              crc_length       = 0;
+};
 
-        vector<string> field_list = split(line, ',');
-        if(!root.empty()) {
-            for(int i=0; i<field_list.size(); i++) {
-                field_list[i] = file_util::path_join(root, field_list[i]);
-            }
+void manifest_csv::parse_buffer()
+{
+    // split the file into chunks that start at a line boundary and parse them
+    // in parallel.  The crc of the records in file order is computed in the
+    // same pass, it is the version unless the records are shuffled or
+    // subsetted later.
+    const size_t size = _buffer.size() - 1;
+    int thread_count = parse_thread_count(size);
+    vector<parse_chunk> chunks(thread_count);
+    size_t begin = 0;
+    for(int i=0; i<thread_count; i++) {
+        size_t end = size * (i + 1) / thread_count;
+        if(end < size) {
+            const char* newline = (const char*)memchr(_buffer.data() + end, '\n', size - end);
+            end = newline ? newline - _buffer.data() + 1 : size;
         }
+        chunks[i].begin = begin;
+        chunks[i].end = max(begin, end);
+        begin = chunks[i].end;
+    }
 
-        if (lineno == 0) {
-            prev_num_fields = field_list.size();
+    if(thread_count == 1) {
+        parse_lines(chunks[0]);
+    } else {
+        vector<thread> threads;
+        for(parse_chunk& chunk : chunks) {
+            threads.emplace_back(&manifest_csv::parse_lines, this, ref(chunk));
         }
+        for(thread& t : threads) {
+            t.join();
+        }
+    }
 
-        if(field_list.size() != prev_num_fields) {
+    // merge in file order, reporting the first bad line exactly as a serial
+    // parse would
+    uint32_t num_fields = 0;
+    uint32_t lineno = 0;
+    CryptoPP::word32 crc = 0;
+    for(parse_chunk& chunk : chunks) {
+        if(chunk.records.empty()) {
+            continue;
+        }
+        if(num_fields == 0) {
+            num_fields = chunk.first_num_fields;
+        }
+        if(chunk.first_num_fields != num_fields) {
+            chunk.bad_record = 0;
+            chunk.bad_num_fields = chunk.first_num_fields;
+        }
+        if(chunk.bad_record != numeric_limits<size_t>::max()) {
             ostringstream ss;
-            ss << "at line: " << lineno;
+            ss << "at line: " << lineno + chunk.bad_record;
             ss << ", manifest file has a line with differing number of files (";
-            ss << field_list.size() << ") vs (" << prev_num_fields << "): ";
-
+            ss << chunk.bad_num_fields << ") vs (" << num_fields << "): ";
+            _strings = _buffer.data();
+            FilenameList field_list = read_fields(chunk.records[chunk.bad_record], chunk.bad_num_fields);
             std::copy(field_list.begin(), field_list.end(),
                       ostream_iterator<std::string>(ss, " "));
             throw std::runtime_error(ss.str());
         }
-        prev_num_fields = field_list.size();
-        _filename_lists.push_back(field_list);
-        lineno++;
+        lineno += chunk.records.size();
+        crc = CryptoPP::CRC32C_Combine(crc, chunk.crc, chunk.crc_length);
+    }
+
+    _nelements = num_fields;
+    vector<uint64_t> records;
+    records.reserve(lineno);
+    for(parse_chunk& chunk : chunks) {
+        records.insert(records.end(), chunk.records.begin(), chunk.records.end());
+        vector<uint64_t>().swap(chunk.records);
+    }
+    _strings = _buffer.data();
+    set_records(move(records));
+    computed_crc = crc;
+    crc_computed = true;
+}
+
+void manifest_csv::parse_lines(parse_chunk& chunk)
+{
+    // find the records in the chunk and terminate each field in place
+    char* data = _buffer.data();
+    CryptoPP::CRC32C crc_engine;
+
+    for(size_t line_begin = chunk.begin; line_begin < chunk.end;) {
+        char* end = (char*)memchr(data + line_begin, '\n', chunk.end - line_begin);
+        size_t line_end = end ? end - data : chunk.end;
+        size_t line_size = line_end - line_begin;
+        size_t next_line = line_end + 1;
+
+        if (line_size == 0 || data[line_begin] == '#')  //Skip comments and empty lines
+        {
+            line_begin = next_line;
+            continue;
+        }
+
+        uint32_t num_fields = 1;
+        for(size_t i=line_begin; i<line_end; i++) {
+            if(data[i] == ',') {
+                data[i] = '\0';
+                num_fields++;
+            }
+        }
+        data[line_end] = '\0';
+
+        if (chunk.records.empty()) {
+            chunk.first_num_fields = num_fields;
+        }
+        if(num_fields != chunk.first_num_fields) {
+            chunk.bad_record = chunk.records.size();
+            chunk.bad_num_fields = num_fields;
+            chunk.records.push_back(line_begin);
+            return;
+        }
+        chunk.records.push_back(line_begin);
+
+        const char* field = data + line_begin;
+        for(uint32_t i=0; i<num_fields; i++) {
+            size_t length = strlen(field);
+            chunk.crc_length += update_crc(crc_engine, field, length);
+            field += length + 1;
+        }
+        line_begin = next_line;
     }
+    crc_engine.TruncatedFinal((uint8_t*)&chunk.crc, sizeof(chunk.crc));
+}
+
+size_t manifest_csv::update_crc(CryptoPP::CRC32C& crc_engine, const char* field, size_t length) const
+{
+    // crc of the field as joined by file_util::path_join, without building
+    // the joined string
+    size_t rc = length;
+    if(!_root.empty() && (length == 0 || field[0] != '/')) {
+        crc_engine.Update((const uint8_t*)_root.data(), _root.size());
+        rc += _root.size();
+        if(length > 0 && _root.back() != '/') {
+            crc_engine.Update((const uint8_t*)"/", 1);
+            rc++;
+        }
+    }
+    crc_engine.Update((const uint8_t*)field, length);
+    return rc;
+}
+
+manifest_csv::FilenameList manifest_csv::record(size_t index) const
+{
+    return read_fields(_offsets[index], _nelements);
+}
+
+manifest_csv::FilenameList manifest_csv::read_fields(uint64_t offset, uint32_t count) const
+{
+    FilenameList rc(count);
+    const char* field = _strings + offset;
+    for(uint32_t i=0; i<count; i++) {
+        size_t length = strlen(field);
+        if(_root.empty()) {
+            rc[i].assign(field, length);
+        } else {
+            rc[i] = file_util::path_join(_root, string(field, length));
+        }
+        field += length + 1;
+    }
+    return rc;
 }
 
 void manifest_csv::shuffle_filename_lists()
 {
-    // shuffles _filename_lists.  It is possible that the order of the
+    // shuffles the records.  It is possible that the order of the
     // filenames in the manifest file were in some sorted order and we
     // don't want our blocks to be biased by that order.
 
     // hardcode random seed to 0 since this step can be cached into a
     // CPIO file.  We don't want to cache anything that is based on a
     // changing random seed, so don't use a changing random seed.
-    std::shuffle(_filename_lists.begin(), _filename_lists.end(), std::mt19937(0));
+    vector<uint64_t> records(_offsets, _offsets + _record_count);
+    std::shuffle(records.begin(), records.end(), std::mt19937(0));
+    set_records(move(records));
+    _index_reorder += "shuffle;";
 }
 
 void manifest_csv::generate_subset(float subset_fraction)
@@ -132,37 +438,100 @@ void manifest_csv::generate_subset(float subset_fraction)
         crc_computed = false;
         std::bernoulli_distribution distribution(subset_fraction);
         std::default_random_engine generator(get_global_random_seed());
-        vector<FilenameList> tmp;
-        tmp.swap(_filename_lists);
-        size_t expected_count = tmp.size() * subset_fraction;
+        vector<uint64_t> records;
+        size_t expected_count = _record_count * subset_fraction;
         size_t needed = expected_count;
 
-        for (int i=0; i<tmp.size(); i++)
+        for (int i=0; i<_record_count; i++)
         {
-            size_t remainder = tmp.size() - i;
+            size_t remainder = _record_count - i;
             if ((needed == remainder) || distribution(generator))
             {
-                _filename_lists.push_back(tmp[i]);
+                records.push_back(_offsets[i]);
                 needed--;
                 if (needed == 0) break;
             }
         }
-//        cout << __FILE__ << " " << __LINE__ << " expected=" << expected_count << ", actual=" << _filename_lists.size() << endl;
+        set_records(move(records));
+        _index_reorder += "subset:" + to_string(subset_fraction) + ":" + to_string(get_global_random_seed()) + ";";
+//        cout << __FILE__ << " " << __LINE__ << " expected=" << expected_count << ", actual=" << _record_count << endl;
     }
 }
 
-uint32_t manifest_csv::get_crc()
+void manifest_csv::generate_shard(int shard_count, int shard_index)
 {
-    if (crc_computed == false)
+    // the records are in the same order on every shard (the manifest shuffle
+    // and the subset are seeded identically), so dealing them out in turn
+    // gives disjoint shards that together cover the dataset.  Records that
+    // don't make a full round are dropped so every shard has the same number
+    // of records and therefore of batches per epoch.
+    affirm(shard_count > 0, "shard_count must be greater than 0");
+    affirm(shard_index >= 0 && shard_index < shard_count, "shard_index must be less than shard_count");
+    if (shard_count > 1)
     {
-        for(const vector<string>& tmp : _filename_lists)
+        crc_computed = false;
+        size_t count = _record_count / shard_count;
+        vector<uint64_t> records(count);
+        for (size_t i=0; i<count; i++)
         {
-            for(const string& s : tmp)
-            {
-                crc_engine.Update((const uint8_t*)s.data(), s.size());
+            records[i] = _offsets[i * shard_count + shard_index];
+        }
+        set_records(move(records));
+        _index_reorder += "shard:" + to_string(shard_index) + ":" + to_string(shard_count) + ";";
+    }
+}
+
+uint32_t manifest_csv::get_crc()
+{
+    if (crc_computed == false && _index_map)
+    {
+        // the stored crc is of the records in index order without a root, fold
+        // in what changed since rather than reading every record again
+        computed_crc = _index_crc;
+        if(!_root.empty() || !_index_reorder.empty()) {
+            string changes = _root + "\n" + _index_reorder;
+            CryptoPP::CRC32C crc_engine;
+            crc_engine.Update((const uint8_t*)&_index_crc, sizeof(_index_crc));
+            crc_engine.Update((const uint8_t*)changes.data(), changes.size());
+            crc_engine.TruncatedFinal((uint8_t*)&computed_crc, sizeof(computed_crc));
+        }
+        crc_computed = true;
+    }
+    else if (crc_computed == false)
+    {
+        // the records were reordered after parsing, crc them in their current
+        // order in parallel and combine the pieces
+        int thread_count = parse_thread_count(_buffer.size());
+        vector<CryptoPP::word32> crcs(thread_count, 0);
+        vector<size_t> lengths(thread_count, 0);
+        auto worker = [&](int index) {
+            CryptoPP::CRC32C crc_engine;
+            size_t begin = _record_count * index / thread_count;
+            size_t end = _record_count * (index + 1) / thread_count;
+            for(size_t r=begin; r<end; r++) {
+                const char* field = _strings + _offsets[r];
+                for(uint32_t i=0; i<_nelements; i++) {
+                    size_t length = strlen(field);
+                    lengths[index] += update_crc(crc_engine, field, length);
+                    field += length + 1;
+                }
             }
+            crc_engine.TruncatedFinal((uint8_t*)&crcs[index], sizeof(crcs[index]));
+        };
+
+        vector<thread> threads;
+        for(int i=1; i<thread_count; i++) {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for(thread& t : threads) {
+            t.join();
+        }
+
+        computed_crc = 0;
+        for(int i=0; i<thread_count; i++) {
+            computed_crc = CryptoPP::CRC32C_Combine(computed_crc, crcs[i], lengths[i]);
         }
-        crc_engine.TruncatedFinal((uint8_t*)&computed_crc, sizeof(computed_crc));
         crc_computed = true;
     }
     return computed_crc;
@@ -170,5 +539,5 @@ uint32_t manifest_csv::get_crc()
 
 int manifest_csv::nelements()
 {
-    return _filename_lists.size() > 0 ? _filename_lists[0].size() : 0;
+    return _record_count > 0 ? _nelements : 0;
 }
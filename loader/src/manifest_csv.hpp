@@ -18,6 +18,7 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <iterator>
 
 #include "manifest.hpp"
 #include "crc.hpp"
@@ -36,6 +37,23 @@
  * that it will be better to use the filename and last modified time as
  * a key instead.
  *
+ * The file is held in memory as read, with each separator overwritten by a
+ * '\0' so that a record is its fields stored back to back, and only the
+ * offset of each record is kept.  Shuffling and subsetting reorder these
+ * offsets.  root is stored once and joined to a field when the record is
+ * read, so memory use is the size of the file plus 8 bytes per record.
+ *
+ * Large files are parsed on several threads, each taking a range of lines and
+ * computing the crc of its records on the way.  The crcs of the ranges are
+ * combined into the version, so no second pass over the records is needed
+ * unless they are shuffled or subsetted.
+ *
+ * The manifest can instead be a binary index written by aeon-manifest-index
+ * (see write_index).  It holds the fields already split, the record offsets,
+ * the crc and the cache id of the csv file, and is memory mapped as is, so
+ * opening it does no parsing.  Its records are only copied when they are
+ * shuffled or subsetted, and version() is then derived from the stored crc
+ * instead of crcing the records again.
  */
 namespace nervana
 {
@@ -46,30 +64,92 @@ class nervana::manifest_csv : public manifest
 {
 public:
     manifest_csv(const std::string& filename, bool shuffle, const std::string& root = "", float subset_fraction = 1.0);
+    ~manifest_csv();
 
     typedef std::vector<std::string> FilenameList;
-    typedef std::vector<FilenameList>::const_iterator iter;
+
+    // random access iterator over the records.  Records are built on access so
+    // dereferencing returns a FilenameList by value.
+    class iter : public std::iterator<std::random_access_iterator_tag, FilenameList, std::ptrdiff_t,
+                                      const FilenameList*, FilenameList>
+    {
+    public:
+        iter(const manifest_csv* manifest, size_t index) : _manifest(manifest), _index(index) {}
+
+        FilenameList operator*() const { return _manifest->record(_index); }
+        FilenameList operator[](std::ptrdiff_t n) const { return _manifest->record(_index + n); }
+        iter& operator++() { ++_index; return *this; }
+        iter operator++(int) { iter rc = *this; ++_index; return rc; }
+        iter& operator--() { --_index; return *this; }
+        iter operator--(int) { iter rc = *this; --_index; return rc; }
+        iter& operator+=(std::ptrdiff_t n) { _index += n; return *this; }
+        iter& operator-=(std::ptrdiff_t n) { _index -= n; return *this; }
+        iter operator+(std::ptrdiff_t n) const { return iter(_manifest, _index + n); }
+        iter operator-(std::ptrdiff_t n) const { return iter(_manifest, _index - n); }
+        std::ptrdiff_t operator-(const iter& other) const { return _index - other._index; }
+        bool operator==(const iter& other) const { return _index == other._index; }
+        bool operator!=(const iter& other) const { return _index != other._index; }
+        bool operator<(const iter& other) const { return _index < other._index; }
+
+    private:
+        const manifest_csv* _manifest;
+        size_t              _index;
+    };
 
     std::string cache_id() override;
     std::string version() override;
-    size_t objectCount() const { return _filename_lists.size(); }
+    size_t objectCount() const { return _record_count; }
     int nelements();
 
     // begin and end provide iterators over the FilenameLists
-    iter begin() const { return _filename_lists.begin(); }
-    iter end() const { return _filename_lists.end(); }
+    iter begin() const { return iter(this, 0); }
+    iter end() const { return iter(this, _record_count); }
+
+    // the fields of record `index`, joined to root
+    FilenameList record(size_t index) const;
 
     void generate_subset(float subset_fraction);
+    // keep every shard_count'th record starting at shard_index, see generate_shard
+    void generate_shard(int shard_count, int shard_index);
     uint32_t get_crc();
 
+    // write the records, in their current order and without root, as a
+    // binary index that can be opened in place of the csv file
+    void write_index(const std::string& filename);
+    static bool is_likely_index(const std::string filename);
+
 protected:
-    void parse_stream(std::istream& is, const std::string& root);
+    struct parse_chunk;
+
+    void parse_buffer();
+    void parse_lines(parse_chunk& chunk);
+    size_t update_crc(CryptoPP::CRC32C& crc_engine, const char* field, size_t length) const;
+    FilenameList read_fields(uint64_t offset, uint32_t count) const;
     void shuffle_filename_lists();
+    void read_csv();
+    void map_index();
+    void set_records(std::vector<uint64_t>&& records);
 
 private:
     const std::string           _filename;
-    std::vector<FilenameList>   _filename_lists;
-    CryptoPP::CRC32C            crc_engine;
+    const std::string           _root;
+    std::vector<char>           _buffer;
+    // offset into _buffer of the first field of each record
+    std::vector<uint64_t>       _records;
+    uint32_t                    _nelements = 0;
+
+    // the fields and record offsets in use, either _buffer and _records or
+    // the mapped index
+    const char*                 _strings = nullptr;
+    const uint64_t*             _offsets = nullptr;
+    size_t                      _record_count = 0;
+
+    void*                       _index_map = nullptr;
+    size_t                      _index_size = 0;
+    std::string                 _index_cache_id;
+    uint32_t                    _index_crc = 0;
+    // how the index records were reordered, part of the version
+    std::string                 _index_reorder;
     bool                        crc_computed = false;
     uint32_t                    computed_crc;
 };
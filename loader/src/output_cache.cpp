@@ -0,0 +1,38 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "output_cache.hpp"
+
+using namespace std;
+using namespace nervana;
+
+output_cache::output_cache(const string& directory, size_t max_bytes, const nlohmann::json& config) :
+    _cache{decoded_cache::open(directory, max_bytes)}
+{
+    string settings = "output " + config.dump();
+    _seed = decoded_cache::key(settings.data(), settings.size(), 0);
+}
+
+bool output_cache::find(const vector<char>& encoded, char* output, size_t size)
+{
+    uint64_t key = decoded_cache::key(encoded.data(), encoded.size(), _seed);
+    return _cache->find(key, encoded.size(), output, size);
+}
+
+void output_cache::add(const vector<char>& encoded, const char* output, size_t size)
+{
+    uint64_t key = decoded_cache::key(encoded.data(), encoded.size(), _seed);
+    _cache->add(key, encoded.size(), cv::Mat(1, size, CV_8U, const_cast<char*>(output)));
+}
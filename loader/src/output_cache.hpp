@@ -0,0 +1,54 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "decoded_cache.hpp"
+
+/* output_cache
+ *
+ * Keeps the loaded output of records whose transforms are deterministic, such
+ * as validation sets with center crops and no flips or photometric jitter.
+ * From the second epoch on such a record is a copy from the cache into the
+ * output buffer instead of a decode, transform and load.
+ *
+ * The storage is a decoded_cache, so it is memory mapped from a file in
+ * `directory` and may share that file with the decoded image cache.  Entries
+ * are keyed by the encoded record and the config the output was made with.
+ */
+
+namespace nervana
+{
+    class output_cache;
+}
+
+class nervana::output_cache
+{
+public:
+    output_cache(const std::string& directory, size_t max_bytes, const nlohmann::json& config);
+
+    // copy the output of `encoded` into `output` if cached
+    bool find(const std::vector<char>& encoded, char* output, size_t size);
+    void add(const std::vector<char>& encoded, const char* output, size_t size);
+
+private:
+    std::shared_ptr<decoded_cache> _cache;
+    uint64_t                       _seed;
+};
@@ -0,0 +1,349 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "packed_file.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static const uint64_t missing = numeric_limits<uint64_t>::max();
+
+static void write_all(int fd, const void* data, size_t size, uint64_t offset, const string& filename)
+{
+    const char* p = (const char*)data;
+    while(size > 0) {
+        ssize_t rc = pwrite(fd, p, size, offset);
+        if(rc < 0) {
+            throw runtime_error("error writing " + filename + ": " + strerror(errno));
+        }
+        p      += rc;
+        size   -= rc;
+        offset += rc;
+    }
+}
+
+static void read_all(int fd, void* data, size_t size, uint64_t offset, const string& filename)
+{
+    char* p = (char*)data;
+    while(size > 0) {
+        ssize_t rc = pread(fd, p, size, offset);
+        if(rc <= 0) {
+            throw runtime_error("error reading " + filename + ": " + (rc < 0 ? strerror(errno) : "unexpected end of file"));
+        }
+        p      += rc;
+        size   -= rc;
+        offset += rc;
+    }
+}
+
+packed_file::writer::writer(const string& filename, uint64_t record_count, uint32_t elements_per_record) :
+    _filename(filename),
+    _temp_name(filename + "." + to_string(getpid()) + ".tmp"),
+    _elements_per_record(elements_per_record),
+    _record_count(record_count),
+    _records_written(0),
+    _data_end(0),
+    _index(record_count * elements_per_record, {missing, 0}),
+    _claimed(record_count, false)
+{
+    _fd = open(_temp_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(_fd < 0) {
+        throw runtime_error("unable to create " + _temp_name + ": " + strerror(errno));
+    }
+}
+
+packed_file::writer::~writer()
+{
+    // an incomplete file is of no use to anyone
+    if(_fd >= 0) {
+        ::close(_fd);
+        unlink(_temp_name.c_str());
+    }
+}
+
+void packed_file::writer::write_records(buffer_in_array& buff, uint64_t first_record)
+{
+    if(buff.size() != _elements_per_record) {
+        throw invalid_argument("packed_file: wrong number of elements per record");
+    }
+    uint64_t count = buff[0]->get_item_count();
+    if(first_record + count > _record_count) {
+        throw invalid_argument("packed_file: record index out of range");
+    }
+
+    // collect everything first so that a bad item leaves the file untouched
+    vector<const vector<char>*> items;
+    uint64_t size = 0;
+    for(uint64_t i=0; i<count; i++) {
+        for(uint32_t j=0; j<_elements_per_record; j++) {
+            const vector<char>& item = buff[j]->get_item(i);
+            items.push_back(&item);
+            size += item.size();
+        }
+    }
+
+    // claim the records nobody wrote yet and reserve space for them, so that
+    // several threads can write at once
+    vector<uint64_t> records;
+    uint64_t offset;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for(uint64_t i=0; i<count; i++) {
+            if(_claimed[first_record + i]) {
+                for(uint32_t j=0; j<_elements_per_record; j++) {
+                    size -= items[i * _elements_per_record + j]->size();
+                }
+            } else {
+                _claimed[first_record + i] = true;
+                records.push_back(i);
+            }
+        }
+        offset = _data_end;
+        _data_end += size;
+    }
+    if(records.empty()) {
+        return;
+    }
+
+    // one large write for the whole block
+    vector<char> data;
+    data.reserve(size);
+    for(uint64_t i : records) {
+        for(uint32_t j=0; j<_elements_per_record; j++) {
+            const vector<char>* item = items[i * _elements_per_record + j];
+            data.insert(data.end(), item->begin(), item->end());
+        }
+    }
+    try {
+        write_all(_fd, data.data(), data.size(), offset, _temp_name);
+    } catch(...) {
+        lock_guard<mutex> lock(_mutex);
+        for(uint64_t i : records) {
+            _claimed[first_record + i] = false;
+        }
+        throw;
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    for(uint64_t i : records) {
+        index_entry* entry = &_index[(first_record + i) * _elements_per_record];
+        for(uint32_t j=0; j<_elements_per_record; j++) {
+            entry[j].offset = offset;
+            entry[j].size   = items[i * _elements_per_record + j]->size();
+            offset += entry[j].size;
+        }
+        _records_written++;
+    }
+}
+
+bool packed_file::writer::contains(uint64_t begin, uint64_t end)
+{
+    if(end > _record_count) {
+        return false;
+    }
+    lock_guard<mutex> lock(_mutex);
+    for(uint64_t record=begin; record<end; record++) {
+        if(_index[record * _elements_per_record].offset == missing) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void packed_file::writer::read_records(buffer_in_array& dest, uint64_t begin, uint64_t end)
+{
+    if(dest.size() != _elements_per_record) {
+        throw invalid_argument("packed_file: wrong number of elements per record");
+    }
+    if(!contains(begin, end)) {
+        throw invalid_argument("packed_file: records not written yet");
+    }
+    vector<index_entry> entries;
+    {
+        lock_guard<mutex> lock(_mutex);
+        entries.assign(_index.begin() + begin * _elements_per_record,
+                       _index.begin() + end * _elements_per_record);
+    }
+    auto entry = entries.begin();
+    for(uint64_t record=begin; record<end; record++) {
+        for(uint32_t j=0; j<_elements_per_record; j++, entry++) {
+            vector<char> data(entry->size);
+            read_all(_fd, data.data(), data.size(), entry->offset, _temp_name);
+            dest[j]->add_item(move(data));
+        }
+    }
+}
+
+bool packed_file::writer::complete()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _records_written == _record_count;
+}
+
+void packed_file::writer::close()
+{
+    lock_guard<mutex> lock(_mutex);
+    if(_fd < 0) {
+        return;
+    }
+    if(_records_written != _record_count) {
+        stringstream ss;
+        ss << "packed_file: only " << _records_written << " of " << _record_count << " records written";
+        throw runtime_error(ss.str());
+    }
+
+    static_assert(sizeof(footer) == 64, "packed file footer is not 64 bytes");
+    static_assert(sizeof(index_entry) == 16, "packed file index entry is not 16 bytes");
+
+    // keep the index 8 byte aligned so the reader can use it in place
+    uint64_t index_offset = (_data_end + 7) & ~uint64_t(7);
+    write_all(_fd, _index.data(), _index.size() * sizeof(index_entry), index_offset, _temp_name);
+
+    footer f;
+    memset(&f, 0, sizeof(f));
+    memcpy(f.magic, PACKED_MAGIC, sizeof(f.magic));
+    f.format_version      = PACKED_FORMAT_VERSION;
+    f.elements_per_record = _elements_per_record;
+    f.record_count        = _record_count;
+    f.index_offset        = index_offset;
+    write_all(_fd, &f, sizeof(f), index_offset + _index.size() * sizeof(index_entry), _temp_name);
+
+    ::close(_fd);
+    _fd = -1;
+    if(rename(_temp_name.c_str(), _filename.c_str()) != 0) {
+        string error = strerror(errno);
+        unlink(_temp_name.c_str());
+        throw runtime_error("Could not create " + _filename + ": " + error);
+    }
+}
+
+packed_file::reader::reader(const string& filename) :
+    _data(nullptr),
+    _file_size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw runtime_error("unable to open " + filename + ": " + strerror(errno));
+    }
+    struct stat stats;
+    if(fstat(fd, &stats) != 0 || (size_t)stats.st_size < sizeof(footer)) {
+        ::close(fd);
+        throw runtime_error(filename + " is not a packed file");
+    }
+    _file_size = stats.st_size;
+    void* data = mmap(nullptr, _file_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        throw runtime_error("unable to map " + filename + ": " + strerror(errno));
+    }
+    _data = (char*)data;
+
+    memcpy(&_footer, _data + _file_size - sizeof(footer), sizeof(footer));
+    uint64_t index_size = _footer.record_count * _footer.elements_per_record * sizeof(index_entry);
+    if(memcmp(_footer.magic, PACKED_MAGIC, sizeof(_footer.magic)) != 0 ||
+       _footer.format_version != PACKED_FORMAT_VERSION ||
+       _footer.index_offset + index_size + sizeof(footer) != _file_size) {
+        munmap(_data, _file_size);
+        throw runtime_error(filename + " is not a valid packed file");
+    }
+    _index = (const index_entry*)(_data + _footer.index_offset);
+}
+
+packed_file::reader::~reader()
+{
+    munmap(_data, _file_size);
+}
+
+const char* packed_file::reader::element(uint64_t record, uint32_t element, size_t& size) const
+{
+    if(record >= _footer.record_count || element >= _footer.elements_per_record) {
+        throw invalid_argument("packed_file: record index out of range");
+    }
+    const index_entry& entry = _index[record * _footer.elements_per_record + element];
+    size = entry.size;
+    return _data + entry.offset;
+}
+
+void packed_file::reader::read_records(buffer_in_array& dest, uint64_t begin, uint64_t end) const
+{
+    if(dest.size() != _footer.elements_per_record) {
+        throw invalid_argument("packed_file: wrong number of elements per record");
+    }
+    for(uint64_t record=begin; record<end; record++) {
+        for(uint32_t j=0; j<_footer.elements_per_record; j++) {
+            size_t size;
+            const char* data = element(record, j, size);
+            dest[j]->add_item(vector<char>(data, data + size));
+        }
+    }
+}
+
+void packed_file::reader::read_records(buffer_in_array& dest, const vector<uint64_t>& records) const
+{
+    if(dest.size() != _footer.elements_per_record) {
+        throw invalid_argument("packed_file: wrong number of elements per record");
+    }
+    for(uint64_t record : records) {
+        for(uint32_t j=0; j<_footer.elements_per_record; j++) {
+            size_t size;
+            const char* data = element(record, j, size);
+            dest[j]->add_item(vector<char>(data, data + size));
+        }
+    }
+}
+
+void packed_file::reader::prefetch(uint64_t begin, uint64_t end) const
+{
+    if(begin >= end || end > _footer.record_count) {
+        return;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    auto advise = [&](uint64_t first, uint64_t last) {
+        first &= ~uint64_t(page - 1);
+        if(last > first) {
+            madvise(_data + first, last - first, MADV_WILLNEED);
+        }
+    };
+
+    // records written as one block are contiguous, so usually this is a single
+    // range.  Records from blocks written far apart are advised one by one.
+    const index_entry* first_entry = &_index[begin * _footer.elements_per_record];
+    const index_entry* end_entry   = &_index[end * _footer.elements_per_record];
+    uint64_t first = numeric_limits<uint64_t>::max();
+    uint64_t last  = 0;
+    uint64_t size  = 0;
+    for(const index_entry* e=first_entry; e!=end_entry; e++) {
+        first = min(first, e->offset);
+        last  = max(last, e->offset + e->size);
+        size += e->size;
+    }
+    if(last - first <= 2 * size) {
+        advise(first, last);
+    } else {
+        for(const index_entry* e=first_entry; e!=end_entry; e++) {
+            advise(e->offset, e->offset + e->size);
+        }
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "buffer_in.hpp"
+#include "record_source.hpp"
+
+#define PACKED_MAGIC            "AEONPACK"
+#define PACKED_FORMAT_VERSION   1
+
+namespace nervana
+{
+    namespace packed_file
+    {
+        class footer;
+        class index_entry;
+        class writer;
+        class reader;
+    }
+}
+
+/*
+
+A packed file holds a whole dataset in one file:
+
+    - element data of every record, back to back, in the order written
+    - index: one index_entry per element of every record, in record order
+    - footer
+
+The footer is at a fixed offset from the end of the file, so a reader finds
+the index without scanning and the location of any record is a single index
+lookup.  Records are not grouped into blocks, so the same file serves any
+macrobatch size.  Records can be written in any order and from several
+threads; the index is only written once every record is present.
+
+*/
+
+class nervana::packed_file::footer
+{
+public:
+#pragma pack(1)
+    char            magic[8];
+    uint32_t        format_version;
+    uint32_t        elements_per_record;
+    uint64_t        record_count;
+    uint64_t        index_offset;
+    uint8_t         unused[32];
+#pragma pack()
+};
+
+class nervana::packed_file::index_entry
+{
+public:
+    uint64_t        offset;
+    uint64_t        size;
+};
+
+class nervana::packed_file::writer
+{
+public:
+    writer(const std::string& filename, uint64_t record_count, uint32_t elements_per_record);
+    ~writer();
+
+    // write the records of `buff` as records first_record, first_record+1, ...
+    // Records that were already written, or are being written by another
+    // thread, are skipped so the file never holds a record twice
+    void write_records(nervana::buffer_in_array& buff, uint64_t first_record);
+
+    // true if every record in [begin, end) was written
+    bool contains(uint64_t begin, uint64_t end);
+
+    // append records [begin, end) to dest, one buffer_in per element, read
+    // back from the unfinished file.  They must all have been written
+    void read_records(nervana::buffer_in_array& dest, uint64_t begin, uint64_t end);
+
+    bool complete();
+
+    // write the index and move the file to its final name.  Throws unless
+    // every record was written.
+    void close();
+
+private:
+    writer(const writer&) = delete;
+
+    std::string                 _filename;
+    std::string                 _temp_name;
+    int                         _fd;
+    uint32_t                    _elements_per_record;
+    uint64_t                    _record_count;
+    uint64_t                    _records_written;
+    uint64_t                    _data_end;
+    std::vector<index_entry>    _index;
+    std::vector<bool>           _claimed;
+    std::mutex                  _mutex;
+};
+
+class nervana::packed_file::reader : public record_source
+{
+public:
+    reader(const std::string& filename);
+    ~reader();
+
+    uint64_t record_count() const override { return _footer.record_count; }
+    uint32_t elements_per_record() const { return _footer.elements_per_record; }
+
+    // points into the mapped file, valid as long as the reader is
+    const char* element(uint64_t record, uint32_t element, size_t& size) const;
+
+    // append records [begin, end) to dest, one buffer_in per element
+    void read_records(nervana::buffer_in_array& dest, uint64_t begin, uint64_t end) const;
+    void read_records(nervana::buffer_in_array& dest, const std::vector<uint64_t>& records) const override;
+
+    // ask the kernel to start reading records [begin, end) ahead of use
+    void prefetch(uint64_t begin, uint64_t end) const;
+
+private:
+    reader(const reader&) = delete;
+
+    char*               _data;
+    size_t              _file_size;
+    footer              _footer;
+    const index_entry*  _index;
+};
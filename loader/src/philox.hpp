@@ -0,0 +1,95 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace nervana
+{
+    class philox;
+}
+
+/* philox
+ *
+ * Counter based random number engine, Philox4x32-10 from Salmon et al.,
+ * "Parallel Random Numbers: As Easy as 1, 2, 3" (SC11).  Every block of four
+ * outputs is a pure function of a 64 bit key and a 128 bit counter, so a
+ * stream can be positioned anywhere without generating what comes before it.
+ *
+ * The engine is keyed with (key0, key1) and the upper half of the counter
+ * selects one of 2^64 independent streams; the lower half counts the blocks
+ * drawn from that stream.  It satisfies the standard uniform random bit
+ * generator requirements and can be handed to the std distributions.
+ */
+class nervana::philox
+{
+public:
+    typedef uint32_t result_type;
+    typedef std::array<uint32_t, 4> counter_type;
+    typedef std::array<uint32_t, 2> key_type;
+
+    philox(uint32_t key0 = 0, uint32_t key1 = 0, uint64_t stream = 0) :
+        _key{{key0, key1}},
+        _counter{{0, 0, (uint32_t)stream, (uint32_t)(stream >> 32)}},
+        _index(4)
+    {
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()()
+    {
+        if(_index == 4) {
+            _output = generate(_counter, _key);
+            if(++_counter[0] == 0) {
+                ++_counter[1];
+            }
+            _index = 0;
+        }
+        return _output[_index++];
+    }
+
+    void discard(unsigned long long count)
+    {
+        for(; count > 0; count--) {
+            (*this)();
+        }
+    }
+
+    static counter_type generate(counter_type counter, key_type key)
+    {
+        for(int i=0; i<10; i++) {
+            if(i > 0) {
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+            uint64_t p0 = (uint64_t)0xD2511F53 * counter[0];
+            uint64_t p1 = (uint64_t)0xCD9E8D57 * counter[2];
+            counter = {{(uint32_t)(p1 >> 32) ^ counter[1] ^ key[0], (uint32_t)p1,
+                        (uint32_t)(p0 >> 32) ^ counter[3] ^ key[1], (uint32_t)p0}};
+        }
+        return counter;
+    }
+
+private:
+    key_type        _key;
+    counter_type    _counter;
+    counter_type    _output;
+    int             _index;
+};
@@ -0,0 +1,297 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* photometric::apply
+ *
+ * The photometric distortions of image::photometric in a single pass over
+ * the pixels.  cbsjitter() converts the whole image to 8 bit HSV and back and
+ * makes a float copy for contrast, and lighting() makes two more passes
+ * through OpenCV expressions.  Here every pixel is read once, adjusted in
+ * float registers and written once, with the mean contrast needs taken in an
+ * extra read-only pass first.
+ *
+ * Brightness, saturation and hue act on V, S and H computed per pixel, and
+ * the pixel is rebuilt from them with the branch free form of the HSV to RGB
+ * conversion.  Nothing is quantized to 8 bits in between, so results differ
+ * from cbsjitter() by the rounding of its HSV image, mostly by a level or
+ * two and by a few levels for saturated colors under hue rotation.
+ *
+ * The kernel is written once on GCC vector extensions and instantiated for
+ * SSE2 and, chosen at run time, for AVX2.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "image.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    typedef float   float4 __attribute__((vector_size(16)));
+    typedef int32_t int4   __attribute__((vector_size(16)));
+    typedef float   float8 __attribute__((vector_size(32)));
+    typedef int32_t int8   __attribute__((vector_size(32)));
+
+    template<typename F> struct int_vector;
+    template<> struct int_vector<float4> { typedef int4 type; };
+    template<> struct int_vector<float8> { typedef int8 type; };
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#if defined(__GNUC__) && !defined(__clang__)
+    // the float8 helpers are only ever inlined into the AVX2 kernel, so
+    // their ABI outside it does not matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+    template<typename F>
+    ALWAYS_INLINE F select(typename int_vector<F>::type mask, F a, F b)
+    {
+        typedef typename int_vector<F>::type I;
+        return (F)(((I)a & mask) | ((I)b & ~mask));
+    }
+
+    template<typename F>
+    ALWAYS_INLINE F vmin(F a, F b) { return select(a < b, a, b); }
+
+    template<typename F>
+    ALWAYS_INLINE F vmax(F a, F b) { return select(a > b, a, b); }
+
+    template<typename F>
+    ALWAYS_INLINE F vfloor(F a)
+    {
+        typedef typename int_vector<F>::type I;
+        F t = __builtin_convertvector(__builtin_convertvector(a, I), F);
+        return t - select(t > a, F{} + 1.f, F{});
+    }
+
+    struct settings
+    {
+        bool  hsv;
+        float brightness;
+        float saturation;
+        float hue;          // in sixths of a turn
+        bool  contrast_enable;
+        float contrast;
+        float offset[3];    // (1 - contrast) * the channel means
+        bool  lighting_enable;
+        float pixel[3];
+        float lighting_scale;
+    };
+
+    // one channel of the pixel with hue `h`, saturation `s` and value `v`,
+    // `n` is 5 for red, 3 for green and 1 for blue
+    template<typename F>
+    ALWAYS_INLINE F hsv_channel(F h, F s, F v, float n)
+    {
+        F k = h + n;
+        k = select(k >= 6.f, k - 6.f, k);
+        F f = vmin(vmax(vmin(k, 4.f - k), F{}), F{} + 1.f);
+        return v * (1.f - s * f);
+    }
+
+    template<typename F>
+    ALWAYS_INLINE void adjust_hsv(F& b, F& g, F& r, const settings& p)
+    {
+        F v = vmax(vmax(b, g), r);
+        F c = v - vmin(vmin(b, g), r);
+        F s = c / vmax(v, F{} + 1e-6f);
+
+        if(p.hue != 0) {
+            F inv_c = 1.f / vmax(c, F{} + 1e-6f);
+            F h = select(v == g, 2.f + (b - r) * inv_c, 4.f + (r - g) * inv_c);
+            h = select(v == r, (g - b) * inv_c, h);
+            h += p.hue;
+            h -= 6.f * vfloor(h * (1.f / 6.f));
+
+            s = vmin(s * p.saturation, F{} + 1.f);
+            v = vmin(v * p.brightness, F{} + 255.f);
+            b = hsv_channel(h, s, v, 1.f);
+            g = hsv_channel(h, s, v, 3.f);
+            r = hsv_channel(h, s, v, 5.f);
+        } else {
+            // with the hue kept every channel stays at the same fraction
+            // of the way from v down to the minimum
+            F new_s = vmin(s * p.saturation, F{} + 1.f);
+            F new_v = vmin(v * p.brightness, F{} + 255.f);
+            F scale = select(c > 0.f, new_v * new_s / vmax(c, F{} + 1e-6f), F{});
+            b = new_v - (v - b) * scale;
+            g = new_v - (v - g) * scale;
+            r = new_v - (v - r) * scale;
+        }
+    }
+
+    const int block_size = 64;
+
+    // adjust `count` pixels, adding the results of brightness, saturation
+    // and hue to `sums` if given, and storing the final pixels to `out`
+    // if given
+    template<typename F>
+    ALWAYS_INLINE void apply_block(const uint8_t* in, uint8_t* out, int count, const settings& p, double* sums)
+    {
+        const int lanes = sizeof(F) / sizeof(float);
+        float plane[3][block_size] __attribute__((aligned(32)));
+        for(int i=0; i<count; i++) {
+            for(int c=0; c<3; c++) {
+                plane[c][i] = in[i * 3 + c];
+            }
+        }
+        for(int i=count; i<block_size; i++) {
+            for(int c=0; c<3; c++) {
+                plane[c][i] = 0;
+            }
+        }
+
+        int vector_count = (count + lanes - 1) / lanes * lanes;
+        for(int i=0; i<vector_count; i+=lanes) {
+            F b, g, r;
+            memcpy(&b, &plane[0][i], sizeof(F));
+            memcpy(&g, &plane[1][i], sizeof(F));
+            memcpy(&r, &plane[2][i], sizeof(F));
+            if(p.hsv) {
+                adjust_hsv(b, g, r, p);
+            }
+            if(out) {
+                if(p.contrast_enable) {
+                    b = vmin(vmax(b * p.contrast + p.offset[0], F{}), F{} + 255.f);
+                    g = vmin(vmax(g * p.contrast + p.offset[1], F{}), F{} + 255.f);
+                    r = vmin(vmax(r * p.contrast + p.offset[2], F{}), F{} + 255.f);
+                }
+                if(p.lighting_enable) {
+                    b = vmin(vmax(b + p.pixel[0], F{}), F{} + 255.f) * p.lighting_scale;
+                    g = vmin(vmax(g + p.pixel[1], F{}), F{} + 255.f) * p.lighting_scale;
+                    r = vmin(vmax(r + p.pixel[2], F{}), F{} + 255.f) * p.lighting_scale;
+                }
+                // round to the nearest 8 bit value
+                b = vfloor(vmin(vmax(b, F{}), F{} + 255.f) + 0.5f);
+                g = vfloor(vmin(vmax(g, F{}), F{} + 255.f) + 0.5f);
+                r = vfloor(vmin(vmax(r, F{}), F{} + 255.f) + 0.5f);
+            }
+            memcpy(&plane[0][i], &b, sizeof(F));
+            memcpy(&plane[1][i], &g, sizeof(F));
+            memcpy(&plane[2][i], &r, sizeof(F));
+        }
+
+        if(sums) {
+            for(int c=0; c<3; c++) {
+                float sum = 0;
+                for(int i=0; i<count; i++) {
+                    sum += plane[c][i];
+                }
+                sums[c] += sum;
+            }
+        }
+        if(out) {
+            for(int i=0; i<count; i++) {
+                for(int c=0; c<3; c++) {
+                    out[i * 3 + c] = plane[c][i];
+                }
+            }
+        }
+    }
+
+    template<typename F>
+    ALWAYS_INLINE void apply_image(cv::Mat& image, settings& p)
+    {
+        if(p.contrast_enable) {
+            // cbsjitter blends towards the channel means after brightness,
+            // saturation and hue, so they are needed before the first pixel
+            double sums[3] = {0, 0, 0};
+            for(int row=0; row<image.rows; row++) {
+                const uint8_t* in = image.ptr<uint8_t>(row);
+                for(int col=0; col<image.cols; col+=block_size) {
+                    int count = min(block_size, image.cols - col);
+                    apply_block<F>(in + col * 3, nullptr, count, p, sums);
+                }
+            }
+            for(int c=0; c<3; c++) {
+                p.offset[c] = (1.0 - p.contrast) * sums[c] / image.total();
+            }
+        }
+        for(int row=0; row<image.rows; row++) {
+            uint8_t* data = image.ptr<uint8_t>(row);
+            for(int col=0; col<image.cols; col+=block_size) {
+                int count = min(block_size, image.cols - col);
+                apply_block<F>(data + col * 3, data + col * 3, count, p, nullptr);
+            }
+        }
+    }
+
+    void apply_default(cv::Mat& image, settings& p)
+    {
+        apply_image<float4>(image, p);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2")))
+    void apply_avx2(cv::Mat& image, settings& p)
+    {
+        apply_image<float8>(image, p);
+    }
+#endif
+
+    typedef void (*apply_function)(cv::Mat&, settings&);
+
+    apply_function select_kernel()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if(__builtin_cpu_supports("avx2")) {
+            return apply_avx2;
+        }
+#endif
+        return apply_default;
+    }
+}
+
+void image::photometric::apply(cv::Mat& inout, float contrast, float brightness, float saturation, int hue,
+                               const vector<float>& lighting, float color_noise_std)
+{
+    settings p;
+    p.hsv             = brightness != 1.0 || saturation != 1.0 || hue != 0;
+    p.contrast_enable = contrast != 1.0;
+    p.lighting_enable = lighting.size() > 0;
+    if(!p.hsv && !p.contrast_enable && !p.lighting_enable) {
+        return;
+    }
+    if(inout.type() != CV_8UC3) {
+        cbsjitter(inout, contrast, brightness, saturation, hue);
+        photometric::lighting(inout, lighting, color_noise_std);
+        return;
+    }
+
+    p.brightness = brightness;
+    p.saturation = saturation;
+    // cbsjitter turns the hue in steps of two degrees
+    p.hue        = (hue / 2) / 30.0f;
+    p.contrast   = contrast;
+    if(p.lighting_enable) {
+        for(int i=0; i<3; i++) {
+            p.pixel[i] = 0;
+            for(int j=0; j<3; j++) {
+                p.pixel[i] += _CPCA[i][j] * CSTD.at<float>(j, 0) * lighting[j];
+            }
+        }
+        p.lighting_scale = 1.0 / (1.0 + color_noise_std);
+    }
+
+    static const apply_function kernel = select_kernel();
+    kernel(inout, p);
+}
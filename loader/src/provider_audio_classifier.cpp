@@ -21,7 +21,7 @@ using namespace std;
 audio_classifier::audio_classifier(nlohmann::json js) :
     audio_config(js["audio"]),
     label_config(js["label"]),
-    audio_extractor(),
+    audio_extractor(audio_config),
     audio_transformer(audio_config),
     audio_loader(audio_config),
     audio_factory(audio_config),
@@ -20,7 +20,7 @@ using namespace std;
 
 audio_only::audio_only(nlohmann::json js) :
     audio_config(js["audio"]),
-    audio_extractor(),
+    audio_extractor(audio_config),
     audio_transformer(audio_config),
     audio_loader(audio_config),
     audio_factory(audio_config)
@@ -28,6 +28,7 @@ class nervana::audio_only : public provider_interface
 public:
     audio_only(nlohmann::json js);
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) override;
+    void seek(uint32_t epoch, uint32_t record) override { audio_factory.seek(epoch, record); }
 
 private:
     audio::config               audio_config;
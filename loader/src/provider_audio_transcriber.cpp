@@ -21,7 +21,7 @@ using namespace std;
 audio_transcriber::audio_transcriber(nlohmann::json js) :
     audio_config(js["audio"]),
     trans_config(js["transcription"]),
-    audio_extractor(),
+    audio_extractor(audio_config),
     audio_transformer(audio_config),
     audio_loader(audio_config),
     audio_factory(audio_config),
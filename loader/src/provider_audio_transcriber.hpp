@@ -29,6 +29,7 @@ class nervana::audio_transcriber : public provider_interface
 public:
     audio_transcriber(nlohmann::json js);
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) override;
+    void seek(uint32_t epoch, uint32_t record) override { audio_factory.seek(epoch, record); }
     void post_process(buffer_out_array& out_buf) override;
     const std::unordered_map<char, uint8_t>& get_cmap() const
     {
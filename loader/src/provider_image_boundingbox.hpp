@@ -31,6 +31,8 @@ public:
     virtual ~image_boundingbox() {}
 
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf);
+    void seek(uint32_t epoch, uint32_t record) { image_factory.seek(epoch, record); }
+    void post_process(buffer_out_array& out_buf) { image_loader.post_process(*out_buf[0]); }
 private:
     image_boundingbox() = delete;
     image::config               image_config;
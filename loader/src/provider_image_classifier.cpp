@@ -30,6 +30,10 @@ image_classifier::image_classifier(nlohmann::json js) :
     label_loader(label_config)
 {
     num_inputs = 2;
+    if(!image_config.output_cache_directory.empty() && image_config.deterministic()) {
+        image_output_cache = make_shared<output_cache>(image_config.output_cache_directory,
+                                                       image_config.output_cache_max_bytes, js["image"]);
+    }
     oshapes.push_back(image_config.get_shape_type());
     oshapes.push_back(label_config.get_shape_type());
 }
@@ -48,9 +52,17 @@ void image_classifier::provide(int idx, buffer_in_array& in_buf, buffer_out_arra
     }
 
     // Process image data
-    auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
-    auto image_params = image_factory.make_params(image_dec);
-    image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+    size_t image_size = image_config.get_shape_type().get_byte_size();
+    if(!image_output_cache || !image_output_cache->find(datum_in, datum_out, image_size)) {
+        shared_ptr<image::params> image_params;
+        auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size(), image_factory, image_params);
+        if(!image_loader.fused_load({datum_out}, image_dec, image_params)) {
+            image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+        }
+        if(image_output_cache) {
+            image_output_cache->add(datum_in, datum_out, image_size);
+        }
+    }
 
     // Process target data
     auto label_dec = label_extractor.extract(target_in.data(), target_in.size());
@@ -29,6 +29,8 @@ class nervana::image_localization : public provider_interface
 public:
     image_localization(nlohmann::json js);
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf);
+    void seek(uint32_t epoch, uint32_t record) { image_factory.seek(epoch, record); }
+    void post_process(buffer_out_array& out_buf) { image_loader.post_process(*out_buf[0]); }
 
 private:
     image::config               image_config;
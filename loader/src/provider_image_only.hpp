@@ -17,6 +17,7 @@
 
 #include "provider_interface.hpp"
 #include "etl_image.hpp"
+#include "output_cache.hpp"
 
 namespace nervana
 {
@@ -28,6 +29,8 @@ class nervana::image_only : public provider_interface
 public:
     image_only(nlohmann::json js);
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf);
+    void seek(uint32_t epoch, uint32_t record) { image_factory.seek(epoch, record); }
+    void post_process(buffer_out_array& out_buf) { image_loader.post_process(*out_buf[0]); }
 
 private:
     image::config               image_config;
@@ -35,4 +38,5 @@ private:
     image::transformer          image_transformer;
     image::loader               image_loader;
     image::param_factory        image_factory;
+    std::shared_ptr<output_cache> image_output_cache;
 };
@@ -47,10 +47,11 @@ void image_pixelmask::provide(int idx, buffer_in_array& in_buf, buffer_out_array
         throw std::runtime_error(ss.str());
     }
 
-    auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
-    auto image_params = image_factory.make_params(image_dec);
-    auto image_transformed = image_transformer.transform(image_params, image_dec);
-    image_loader.load({datum_out}, image_transformed);
+    shared_ptr<image::params> image_params;
+    auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size(), image_factory, image_params);
+    if(!image_loader.fused_load({datum_out}, image_dec, image_params)) {
+        image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+    }
 
     // Process target data
     auto target_dec = target_extractor.extract(target_in.data(), target_in.size());
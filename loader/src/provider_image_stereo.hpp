@@ -30,6 +30,12 @@ public:
     image_stereo_blob(nlohmann::json js);
 
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf);
+    void seek(uint32_t epoch, uint32_t record) { image_factory.seek(epoch, record); }
+    void post_process(buffer_out_array& out_buf)
+    {
+        image_loader.post_process(*out_buf[0]);
+        image_loader.post_process(*out_buf[1]);
+    }
 
 private:
     image::config               image_config;
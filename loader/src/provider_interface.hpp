@@ -32,6 +32,13 @@ public:
     virtual void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) = 0;
     virtual void post_process(buffer_out_array& out_buf) {}
 
+    // called before provide() with the epoch and the position of the item in
+    // the epoch's output; providers with random transforms key their params
+    // on it, not on the manifest record it came from, so that they do not
+    // depend on thread scheduling and a resumed loader makes the same params
+    // as an uninterrupted one
+    virtual void seek(uint32_t epoch, uint32_t record) {}
+
     virtual const std::vector<nervana::shape_type>& get_oshapes() { return oshapes; }
     uint32_t num_inputs;
 protected:
@@ -29,6 +29,7 @@ class nervana::video_classifier : public provider_interface
 public:
     video_classifier(nlohmann::json js);
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf);
+    void seek(uint32_t epoch, uint32_t record) { frame_factory.seek(epoch, record); }
 
 private:
     video::config               video_config;
@@ -28,6 +28,7 @@ class nervana::video_only : public provider_interface
 public:
     video_only(nlohmann::json js);
     void provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf);
+    void seek(uint32_t epoch, uint32_t record) { frame_factory.seek(epoch, record); }
 
 private:
     video::config               video_config;
@@ -0,0 +1,42 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "buffer_in.hpp"
+
+/*
+ * A record_source reads arbitrary records of a dataset by their index, as
+ * opposed to a block_loader which only reads whole blocks.  Caches provide one
+ * once every record has been cached (see block_loader::get_record_source).
+ */
+
+namespace nervana
+{
+    class record_source;
+}
+
+class nervana::record_source
+{
+public:
+    virtual ~record_source() {}
+
+    virtual uint64_t record_count() const = 0;
+
+    // append `records` to dest in the order given, one buffer_in per element
+    virtual void read_records(nervana::buffer_in_array& dest, const std::vector<uint64_t>& records) const = 0;
+};
@@ -26,6 +26,9 @@ namespace nervana
     class output_type;
     class shape_type;
 
+    // numpy type, OpenCV depth and size.  float16 and bfloat16 have no OpenCV
+    // depth, they are computed as CV_32F and narrowed by half::convert().
+    // numpy has no bfloat16 either, so those arrays hold the raw bits
     static const std::map<std::string, std::tuple<int, int, size_t>> all_outputs {
         {"int8_t",   std::make_tuple<int, int, size_t>(NPY_INT8,    CV_8S,  sizeof(int8_t))},
         {"uint8_t",  std::make_tuple<int, int, size_t>(NPY_UINT8,   CV_8U,  sizeof(uint8_t))},
@@ -35,6 +38,8 @@ namespace nervana
         {"uint32_t", std::make_tuple<int, int, size_t>(NPY_UINT32,  CV_32S, sizeof(uint32_t))},
         {"float",    std::make_tuple<int, int, size_t>(NPY_FLOAT32, CV_32F, sizeof(float))},
         {"double",   std::make_tuple<int, int, size_t>(NPY_FLOAT64, CV_64F, sizeof(double))},
+        {"float16",  std::make_tuple<int, int, size_t>(NPY_FLOAT16, CV_32F, sizeof(uint16_t))},
+        {"bfloat16", std::make_tuple<int, int, size_t>(NPY_UINT16,  CV_32F, sizeof(uint16_t))},
         {"char",     std::make_tuple<int, int, size_t>(NPY_INT8,    CV_8S,  sizeof(char))}
     };
 }
@@ -59,6 +64,10 @@ public:
     static bool is_valid_type( const std::string& s ) {
         return all_outputs.find(s) != all_outputs.end();
     }
+    // stored narrower than cv_type, see half::convert()
+    bool is_half() const {
+        return tp_name == "float16" || tp_name == "bfloat16";
+    }
 
     std::string tp_name;
     int np_type;
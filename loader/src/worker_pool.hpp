@@ -0,0 +1,141 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nervana {
+    class worker_pool;
+}
+
+/* worker_pool
+ *
+ * A fixed set of threads kept waiting for work, for stages that split every
+ * minibatch into parallel tasks and cannot afford to start threads each time.
+ * run() hands out the tasks to the pool and to the calling thread and
+ * returns once all of them are done.  The first exception a task throws is
+ * rethrown by run() on the calling thread.
+ */
+class nervana::worker_pool
+{
+public:
+    // `count` threads in addition to the one calling run()
+    explicit worker_pool(int count) :
+        _task(nullptr),
+        _task_count(0),
+        _next(0),
+        _busy(0),
+        _generation(0),
+        _done(false)
+    {
+        for (int i = 0; i < count; i++) {
+            _threads.emplace_back(&worker_pool::work, this);
+        }
+    }
+
+    ~worker_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done = true;
+        }
+        _start.notify_all();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    // threads run() spreads the tasks over, including the caller
+    int size() const { return _threads.size() + 1; }
+
+    // call task(i) for every i in [0, task_count)
+    void run(size_t task_count, const std::function<void(size_t)>& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task       = &task;
+            _task_count = task_count;
+            _next       = 0;
+            _error      = nullptr;
+            _busy       = _threads.size();
+            _generation++;
+        }
+        _start.notify_all();
+        execute();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _finished.wait(lock, [this]{ return _busy == 0; });
+        _task = nullptr;
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+private:
+    worker_pool(const worker_pool&) = delete;
+
+    void execute()
+    {
+        size_t i;
+        while ((i = _next++) < _task_count) {
+            try {
+                (*_task)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error) {
+                    _error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    void work()
+    {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _start.wait(lock, [&]{ return _done || _generation != seen; });
+            if (_done) {
+                return;
+            }
+            seen = _generation;
+            lock.unlock();
+            execute();
+            lock.lock();
+            if (--_busy == 0) {
+                _finished.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread>                _threads;
+    std::mutex                              _mutex;
+    std::condition_variable                 _start;
+    std::condition_variable                 _finished;
+    const std::function<void(size_t)>*      _task;
+    size_t                                  _task_count;
+    std::atomic<size_t>                     _next;
+    size_t                                  _busy;
+    uint64_t                                _generation;
+    bool                                    _done;
+    std::exception_ptr                      _error;
+};
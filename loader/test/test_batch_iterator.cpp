@@ -13,12 +13,15 @@
  limitations under the License.
 */
 
+#include <functional>
+
 #include "gtest/gtest.h"
 
 #include "helpers.hpp"
 #include "batch_iterator.hpp"
 #include "block_iterator_sequential.hpp"
 #include "block_iterator_shuffled.hpp"
+#include "block_iterator_shuffle_buffer.hpp"
 #include "block_loader_util.hpp"
 
 using namespace std;
@@ -90,3 +93,45 @@ TEST(minibatch_iterator, shuffled)
     assert_vector_unique(words_a);
 
 }
+
+static vector<string> read_minibatches(batch_iterator& mi, int count)
+{
+    vector<string> words;
+    for(int i = 0; i < count; ++i) {
+        buffer_in_array bp(2);
+        mi.read(bp);
+        vector<string> batch = buffer_to_vector_of_strings(*bp[0]);
+        words.insert(words.end(), batch.begin(), batch.end());
+    }
+    return words;
+}
+
+TEST(minibatch_iterator, seek)
+{
+    // a seeked batch_iterator continues with exactly the records one that
+    // read its way there would have returned.  7 does not divide the 78
+    // records so minibatches straddle epochs.
+    vector<function<shared_ptr<block_iterator>(shared_ptr<block_loader>)>> makers = {
+        [](shared_ptr<block_loader> mbl) { return make_shared<block_iterator_sequential>(mbl); },
+        [](shared_ptr<block_loader> mbl) { return make_shared<block_iterator_shuffled>(mbl); },
+        [](shared_ptr<block_loader> mbl) {
+            auto source = make_shared<block_iterator_shuffled>(mbl);
+            return make_shared<block_iterator_shuffle_buffer>(source, mbl, 4, 10);
+        }
+    };
+
+    for(auto& make_iterator : makers) {
+        auto mbl = make_shared<block_loader_alphabet>(3);
+        uint32_t num_records = mbl->object_count();
+        batch_iterator reference(make_iterator(mbl), 7);
+        vector<string> words = read_minibatches(reference, 40);
+
+        for(int batch : {0, 1, 5, 11, 12, 23, 34}) {
+            uint32_t position = batch * 7;
+            batch_iterator resumed(make_iterator(mbl), 7);
+            resumed.seek(position / num_records, position % num_records);
+            vector<string> rest = read_minibatches(resumed, 40 - batch);
+            ASSERT_EQ(vector<string>(words.begin() + position, words.end()), rest);
+        }
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_iterator_global_shuffle.hpp"
+#include "block_loader_cpio_cache.hpp"
+#include "cpio_record_index.hpp"
+#include "block_loader_util.hpp"
+#include "file_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static shared_ptr<block_loader_cpio_cache> make_alphabet_cache(const string& root)
+{
+    return make_shared<block_loader_cpio_cache>(root, block_loader_random::randomString(), "version123",
+                                                make_shared<block_loader_alphabet>(5));
+}
+
+TEST(cpio_record_index, read_records)
+{
+    string root = file_util::make_temp_directory();
+    auto cache = make_alphabet_cache(root);
+    EXPECT_EQ(nullptr, cache->get_record_source());
+    for(uint32_t i=0; i<26; i++) {
+        buffer_in_array bp(2);
+        cache->load_block(bp, i);
+    }
+
+    auto records = cache->get_record_source();
+    ASSERT_NE(nullptr, records);
+    EXPECT_EQ(26 * 5, records->record_count());
+
+    // neighbouring records are coalesced into one read, the order asked for
+    // is kept
+    buffer_in_array bp(2);
+    records->read_records(bp, {7, 0, 129, 8, 1});
+    vector<string> words = buffer_to_vector_of_strings(*bp[0]);
+    vector<string> expected = {"Bc", "Aa", "Ze", "Bd", "Ab"};
+    EXPECT_EQ(expected, words);
+    EXPECT_EQ(expected, buffer_to_vector_of_strings(*bp[1]));
+
+    file_util::remove_directory(root);
+}
+
+TEST(block_iterator_global_shuffle, epochs)
+{
+    string root = file_util::make_temp_directory();
+    auto cache = make_alphabet_cache(root);
+    block_iterator_global_shuffle iter(cache);
+    uint32_t num_records = cache->object_count();
+
+    for(int epoch=0; epoch<3; epoch++) {
+        vector<string> words;
+        size_t blocks_mixing_letters = 0;
+        for(uint32_t i=0; i<26; i++) {
+            buffer_in_array bp(2);
+            iter.read(bp);
+            vector<string> block_a = buffer_to_vector_of_strings(*bp[0]);
+            vector<string> block_b = buffer_to_vector_of_strings(*bp[1]);
+            ASSERT_EQ(5, block_a.size());
+            ASSERT_EQ(block_a, block_b);
+
+            set<char> letters;
+            for(const string& word : block_a) {
+                letters.insert(word[0]);
+            }
+            if(letters.size() > 1) {
+                blocks_mixing_letters++;
+            }
+            words.insert(words.end(), block_a.begin(), block_a.end());
+        }
+
+        ASSERT_EQ(num_records, words.size());
+        assert_vector_unique(words);
+
+        if(epoch == 0) {
+            // the first epoch fills the cache, only whole blocks are shuffled
+            EXPECT_EQ(0, blocks_mixing_letters);
+        } else {
+            EXPECT_GT(blocks_mixing_letters, 0);
+        }
+    }
+
+    file_util::remove_directory(root);
+}
+
+TEST(block_iterator_global_shuffle, seek)
+{
+    string root = file_util::make_temp_directory();
+    auto cache = make_alphabet_cache(root);
+    block_iterator_global_shuffle reference(cache);
+    reference.reset();
+    vector<string> words;
+    for(uint32_t i=0; i<3*26; i++) {
+        buffer_in_array bp(2);
+        reference.read(bp);
+        vector<string> block = buffer_to_vector_of_strings(*bp[0]);
+        words.insert(words.end(), block.begin(), block.end());
+    }
+
+    // once the cache is complete any epoch can be seeked to, at any record
+    for(uint32_t epoch : {1, 2}) {
+        for(uint32_t record : {0, 5, 37, 129}) {
+            block_iterator_global_shuffle resumed(cache);
+            resumed.reset();
+            EXPECT_EQ(0, resumed.seek(epoch, record));
+
+            buffer_in_array bp(2);
+            resumed.read(bp);
+            size_t first = epoch * 130 + record;
+            size_t last = min<size_t>(first + 5, (epoch + 1) * 130);
+            EXPECT_EQ(vector<string>(words.begin() + first, words.begin() + last),
+                      buffer_to_vector_of_strings(*bp[0]));
+        }
+    }
+
+    file_util::remove_directory(root);
+}
@@ -0,0 +1,89 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_iterator_shuffle_buffer.hpp"
+#include "block_iterator_sequential.hpp"
+#include "block_loader_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(block_iterator_shuffle_buffer, epochs)
+{
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto source = make_shared<block_iterator_sequential>(mbl);
+    block_iterator_shuffle_buffer iter(source, mbl, 4, 10);
+    uint32_t num_records = mbl->object_count();
+
+    for(int epoch=0; epoch<2; epoch++) {
+        vector<string> words;
+        size_t blocks_mixing_letters = 0;
+        for(uint32_t i=0; i<mbl->block_count(); i++) {
+            buffer_in_array bp(2);
+            iter.read(bp);
+            vector<string> block_a = buffer_to_vector_of_strings(*bp[0]);
+            vector<string> block_b = buffer_to_vector_of_strings(*bp[1]);
+            ASSERT_EQ(5, block_a.size());
+
+            // ensure that there is correspondence between the elements of each record
+            ASSERT_EQ(block_a, block_b);
+
+            set<char> letters;
+            for(const string& word : block_a) {
+                letters.insert(word[0]);
+            }
+            if(letters.size() > 1) {
+                blocks_mixing_letters++;
+            }
+            words.insert(words.end(), block_a.begin(), block_a.end());
+        }
+
+        // every record once per epoch, in an order mixed across blocks
+        ASSERT_EQ(num_records, words.size());
+        ASSERT_EQ(sorted(words), false);
+        assert_vector_unique(words);
+        EXPECT_GT(blocks_mixing_letters, 0);
+    }
+}
+
+TEST(block_iterator_shuffle_buffer, memory_usage)
+{
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto source = make_shared<block_iterator_sequential>(mbl);
+    block_iterator_shuffle_buffer iter(source, mbl, 3, 7);
+    EXPECT_EQ(0, iter.memory_usage());
+
+    // each record is two 2 byte items, at most 3 open blocks and the 7 record
+    // reservoir are held between reads
+    size_t max_usage = 0;
+    for(uint32_t i=0; i<mbl->block_count(); i++) {
+        buffer_in_array bp(2);
+        iter.read(bp);
+        max_usage = max(max_usage, iter.memory_usage());
+        EXPECT_LE(iter.memory_usage(), (3 * 5 + 7) * 4);
+    }
+    EXPECT_GT(max_usage, 0);
+
+    // the epoch is drained
+    EXPECT_EQ(0, iter.memory_usage());
+
+    iter.reset();
+    EXPECT_EQ(0, iter.memory_usage());
+}
@@ -62,6 +62,35 @@ TEST(block_loader_file, load_block)
     }
 }
 
+TEST(block_loader_file, read_block)
+{
+    // read_block must return the same records as load_block without
+    // disturbing the prefetch state
+    manifest_maker mm;
+    uint32_t block_size = 3;
+    uint32_t object_size = 16;
+    uint32_t target_size = 16;
+
+    block_loader_file blf(
+        make_shared<nervana::manifest_csv>(mm.tmp_manifest_file(8, {object_size, target_size}), false),
+        1.0,
+        block_size
+    );
+
+    for(uint32_t block_num=0; block_num<blf.block_count(); block_num++) {
+        buffer_in_array loaded(2);
+        buffer_in_array read(2);
+        blf.load_block(loaded, block_num);
+        blf.read_block(read, block_num);
+
+        ASSERT_EQ(loaded[0]->get_item_count(), read[0]->get_item_count());
+        for(int i=0; i<loaded[0]->get_item_count(); i++) {
+            EXPECT_EQ(loaded[0]->get_item(i), read[0]->get_item(i));
+            EXPECT_EQ(loaded[1]->get_item(i), read[1]->get_item(i));
+        }
+    }
+}
+
 TEST(block_loader_file, subset_fraction)
 {
     // a 10 object manifest iterated through blocks sized 4 with
@@ -0,0 +1,77 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "gtest/gtest.h"
+#include "block_loader_memory_cache.hpp"
+#include "block_loader_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static string load_string(block_loader& loader, uint32_t block_num)
+{
+    buffer_in_array bp(2);
+    loader.load_block(bp, block_num);
+    vector<char>& x = bp[0]->get_item(0);
+    return string(x.data(), x.size());
+}
+
+TEST(block_loader_memory_cache, hit)
+{
+    // block_loader_random returns different data on every call so equal
+    // strings can only come from the cache
+    block_loader_memory_cache cache(make_shared<block_loader_random>(1), 1 << 20);
+
+    string first = load_string(cache, 3);
+    ASSERT_EQ(first, load_string(cache, 3));
+    ASSERT_NE(first, load_string(cache, 4));
+    ASSERT_EQ(2, cache.cached_block_count());
+}
+
+TEST(block_loader_memory_cache, zero_copy)
+{
+    block_loader_memory_cache cache(make_shared<block_loader_alphabet>(5), 1 << 20);
+
+    buffer_in_array first(2);
+    cache.load_block(first, 0);
+    buffer_in_array second(2);
+    cache.load_block(second, 0);
+
+    ASSERT_EQ(5, second[0]->get_item_count());
+    for(int i=0; i<5; i++) {
+        EXPECT_EQ(first[0]->get_shared_item(i), second[0]->get_shared_item(i));
+        EXPECT_EQ(first[1]->get_shared_item(i), second[1]->get_shared_item(i));
+    }
+}
+
+TEST(block_loader_memory_cache, size_limit)
+{
+    // each alphabet block holds 5 records of 2 elements of 2 bytes, 20 bytes
+    block_loader_memory_cache cache(make_shared<block_loader_alphabet>(5), 50);
+
+    for(int pass=0; pass<2; pass++) {
+        for(uint32_t block_num=0; block_num<26; block_num++) {
+            buffer_in_array bp(2);
+            cache.load_block(bp, block_num);
+            ASSERT_EQ(5, bp[0]->get_item_count());
+            vector<char>& x = bp[1]->get_item(4);
+            EXPECT_EQ(string(1, 'A' + block_num) + "e", string(x.data(), x.size()));
+        }
+    }
+
+    // the first blocks are kept, later ones are never admitted
+    EXPECT_EQ(2, cache.cached_block_count());
+    EXPECT_EQ(40, cache.size_bytes());
+}
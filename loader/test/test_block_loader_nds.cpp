@@ -91,6 +91,20 @@ TEST(block_loader_nds, curl_stream)
     ASSERT_EQ(stream.str(), expected.str());
 }
 
+TEST(block_loader_nds, curl_keep_alive)
+{
+    start_server();
+    block_loader_nds client("http://127.0.0.1:5000", "token", 1, 16, 1, 0);
+
+    // sequential requests share one handle and with it the connection
+    for(int i=0; i<3; i++) {
+        stringstream stream;
+        client.get("http://127.0.0.1:5000/test_pattern/", stream);
+        ASSERT_EQ(1024 * 16, stream.str().size());
+        EXPECT_EQ(1, client._idle_handles.size());
+    }
+}
+
 TEST(block_loader_nds, curl_stream_error)
 {
     start_server();
@@ -125,6 +139,41 @@ TEST(block_loader_nds, cpio)
     ASSERT_EQ(dest[0]->get_item_count(), 4);
 }
 
+TEST(block_loader_nds, concurrent_prefetch)
+{
+    start_server();
+    auto client = make_shared<block_loader_nds>("http://127.0.0.1:5000", "token", 1, 16, 1, 0, 3, 0);
+    EXPECT_EQ(3, client->prefetch_depth());
+
+    // the iterator asks for the first three blocks at once
+    block_iterator_sequential iter(client);
+    EXPECT_EQ(3, client->_requests.size());
+
+    for(int i=0; i<10; i++) {
+        buffer_in_array dest(2);
+        iter.read(dest);
+        ASSERT_EQ(4, dest[0]->get_item_count());
+        ASSERT_EQ(4, dest[1]->get_item_count());
+    }
+}
+
+TEST(block_loader_nds, retry)
+{
+    start_server();
+
+    // the flaky server fails every other request for a macrobatch
+    block_loader_nds client("http://127.0.0.1:5000/flaky", "token", 1, 16, 1, 0, 2, 1);
+    for(uint32_t block=0; block<client.block_count(); block++) {
+        buffer_in_array dest(2);
+        client.load_block(dest, block);
+        ASSERT_EQ(4, dest[0]->get_item_count());
+    }
+
+    block_loader_nds no_retries("http://127.0.0.1:5000/flaky", "token", 1, 16, 1, 0, 2, 0);
+    buffer_in_array dest(2);
+    EXPECT_THROW(no_retries.load_block(dest, 4), std::runtime_error);
+}
+
 string generate_large_cpio_file()
 {
     char name[8192];
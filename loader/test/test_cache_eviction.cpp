@@ -0,0 +1,128 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/time.h>
+
+#include <fstream>
+
+#include "gtest/gtest.h"
+#include "cache_eviction.hpp"
+#include "block_loader_cpio_cache.hpp"
+#include "block_loader_util.hpp"
+#include "file_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static string write_block(const string& dir, const string& name, size_t size, time_t mtime)
+{
+    string filename = file_util::path_join(dir, name + cache_eviction::block_extension);
+    ofstream f(filename, ios::binary);
+    f << string(size, 'x');
+    f.close();
+
+    struct timeval times[2] = {{mtime, 0}, {mtime, 0}};
+    utimes(filename.c_str(), times);
+    return filename;
+}
+
+TEST(cache_eviction, under_limit)
+{
+    string root = file_util::make_temp_directory();
+    string dataset = file_util::path_join(root, "dataset");
+    file_util::make_directory(dataset);
+    write_block(dataset, "0", 100, 1000);
+    write_block(dataset, "1", 100, 1000);
+
+    cache_eviction eviction(root, 1000);
+    EXPECT_EQ(200, eviction.usage());
+    EXPECT_TRUE(file_util::exists(file_util::path_join(dataset, "0.cpio")));
+    EXPECT_TRUE(file_util::exists(file_util::path_join(dataset, "1.cpio")));
+
+    file_util::remove_directory(root);
+}
+
+TEST(cache_eviction, lru_dataset_first)
+{
+    string root = file_util::make_temp_directory();
+    string old_dataset = file_util::path_join(root, "old");
+    string new_dataset = file_util::path_join(root, "new");
+    file_util::make_directory(old_dataset);
+    file_util::make_directory(new_dataset);
+
+    // the old dataset has the oldest and the newest block but it was still
+    // used before the new dataset as a whole
+    string old_0 = write_block(old_dataset, "0", 100, 1000);
+    string new_0 = write_block(new_dataset, "0", 100, 2000);
+    string new_1 = write_block(new_dataset, "1", 100, 3000);
+    string new_2 = write_block(new_dataset, "2", 100, 4000);
+
+    cache_eviction eviction(root, 350, 0.9);
+
+    EXPECT_FALSE(file_util::exists(old_0));
+    EXPECT_FALSE(file_util::exists(old_dataset));
+    EXPECT_TRUE(file_util::exists(new_0));
+    EXPECT_TRUE(file_util::exists(new_1));
+    EXPECT_TRUE(file_util::exists(new_2));
+    EXPECT_EQ(300, eviction.usage());
+
+    // a new block pushes usage over the limit and the oldest block of the
+    // only dataset left goes
+    string new_3 = write_block(new_dataset, "3", 100, 5000);
+    eviction.block_written(new_3);
+    EXPECT_FALSE(file_util::exists(new_0));
+    EXPECT_TRUE(file_util::exists(new_1));
+    EXPECT_TRUE(file_util::exists(new_2));
+    EXPECT_TRUE(file_util::exists(new_3));
+    EXPECT_EQ(300, eviction.usage());
+
+    file_util::remove_directory(root);
+}
+
+TEST(cache_eviction, keep_dataset_being_written)
+{
+    string root = file_util::make_temp_directory();
+    string dataset = file_util::path_join(root, "dataset");
+    file_util::make_directory(dataset);
+    string block = write_block(dataset, "0", 100, 1000);
+    file_util::touch(file_util::path_join(dataset, cache_eviction::owner_lock_filename));
+
+    cache_eviction eviction(root, 50);
+    EXPECT_FALSE(file_util::exists(block));
+    EXPECT_TRUE(file_util::exists(dataset));
+
+    file_util::remove_directory(root);
+}
+
+TEST(cache_eviction, cache_refills_evicted_blocks)
+{
+    string root = file_util::make_temp_directory();
+    block_loader_cpio_cache cache(root, block_loader_random::randomString(), "version123",
+                                  make_shared<block_loader_alphabet>(5), 1);
+
+    // with a 1 byte limit every block is evicted as soon as the next one is
+    // written, yet every block still loads with the right contents
+    for(int pass=0; pass<2; pass++) {
+        for(uint32_t block_num=0; block_num<26; block_num++) {
+            buffer_in_array bp(2);
+            cache.load_block(bp, block_num);
+            ASSERT_EQ(5, bp[0]->get_item_count());
+            vector<char>& x = bp[0]->get_item(0);
+            EXPECT_EQ(string(1, 'A' + block_num), string(x.data(), 1));
+        }
+    }
+
+    file_util::remove_directory(root);
+}
@@ -17,10 +17,13 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <fstream>
+#include <iterator>
 
 #include "gtest/gtest.h"
 #include "cpio.hpp"
 #include "buffer_in.hpp"
+#include "file_util.hpp"
 
 #define private public
 
@@ -39,3 +42,48 @@ TEST(cpio, read_nds)
     reader.read(buffer);
     EXPECT_EQ(1, buffer.get_item_count());
 }
+
+TEST(cpio, stream_reader)
+{
+    // odd sizes exercise the padding after names and entries
+    buffer_in_array records(2);
+    for(int i=0; i<20; i++) {
+        records[0]->add_item(vector<char>(i * 37 + 1, 'a' + i));
+        records[1]->add_item(vector<char>(i % 3, '0' + i));
+    }
+    string filename = file_util::tmp_filename();
+    {
+        cpio::file_writer writer;
+        writer.open(filename);
+        writer.write_all_records(records);
+    }
+    ifstream file(filename, istream::binary);
+    string archive((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file_util::remove_file(filename);
+
+    // the archive arrives in pieces of any size, down to single bytes
+    for(size_t piece : {1, 5, 64, 4096}) {
+        vector<vector<char>> elements;
+        cpio::stream_reader reader([&elements](vector<char>&& element) {
+            elements.push_back(move(element));
+        });
+        for(size_t offset=0; offset<archive.size(); offset+=piece) {
+            reader.write(archive.data() + offset, min(piece, archive.size() - offset));
+        }
+        EXPECT_TRUE(reader.complete());
+        EXPECT_EQ(20, reader.itemCount());
+
+        ASSERT_EQ(40, elements.size());
+        for(int i=0; i<20; i++) {
+            EXPECT_EQ(records[0]->get_item(i), elements[i * 2]);
+            EXPECT_EQ(records[1]->get_item(i), elements[i * 2 + 1]);
+        }
+    }
+
+    cpio::stream_reader partial([](vector<char>&&) {});
+    partial.write(archive.data(), archive.size() - 20);
+    EXPECT_FALSE(partial.complete());
+
+    cpio::stream_reader reader([](vector<char>&&) {});
+    EXPECT_THROW(reader.write("not a cpio archive, not at all", 30), std::runtime_error);
+}
@@ -0,0 +1,144 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "gtest/gtest.h"
+#include "decoded_cache.hpp"
+#include "output_cache.hpp"
+#include "file_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static cv::Mat make_image(int rows, int cols, uint8_t value)
+{
+    cv::Mat image(rows, cols, CV_8UC3);
+    memset(image.data, value, image.total() * image.elemSize());
+    return image;
+}
+
+TEST(decoded_cache, key)
+{
+    string a = "some encoded bytes";
+    string b = "some encoded byteS";
+    EXPECT_EQ(decoded_cache::key(a.data(), a.size(), 0), decoded_cache::key(a.data(), a.size(), 0));
+    EXPECT_NE(decoded_cache::key(a.data(), a.size(), 0), decoded_cache::key(b.data(), b.size(), 0));
+    EXPECT_NE(decoded_cache::key(a.data(), a.size(), 0), decoded_cache::key(a.data(), a.size(), 1));
+    EXPECT_NE(decoded_cache::key(a.data(), a.size() - 1, 0), decoded_cache::key(a.data(), a.size(), 0));
+}
+
+TEST(decoded_cache, find)
+{
+    string dir = file_util::make_temp_directory();
+    decoded_cache cache(dir, 1 << 20);
+
+    cv::Mat image = make_image(10, 20, 7);
+    cv::Mat found;
+    EXPECT_FALSE(cache.find(1, 100, found));
+    cache.add(1, 100, image);
+    ASSERT_TRUE(cache.find(1, 100, found));
+    EXPECT_EQ(image.rows, found.rows);
+    EXPECT_EQ(image.cols, found.cols);
+    EXPECT_EQ(image.type(), found.type());
+    EXPECT_EQ(0, memcmp(image.data, found.data, image.total() * image.elemSize()));
+
+    // the encoded size is checked as a guard against key collisions
+    EXPECT_FALSE(cache.find(1, 101, found));
+
+    // hits are copies, changing one does not change the cache
+    memset(found.data, 0, found.total() * found.elemSize());
+    cv::Mat again;
+    ASSERT_TRUE(cache.find(1, 100, again));
+    EXPECT_EQ(7, again.data[0]);
+
+    // the backing file was unlinked, nothing is left behind
+    int files = 0;
+    file_util::iterate_files(dir, [&](const string&, bool) { files++; });
+    EXPECT_EQ(0, files);
+    file_util::remove_directory(dir);
+}
+
+TEST(decoded_cache, roi)
+{
+    string dir = file_util::make_temp_directory();
+    decoded_cache cache(dir, 1 << 20);
+
+    cv::Mat image = make_image(10, 20, 0);
+    image.at<uint8_t>(2, 3 * 3) = 42;
+    cv::Mat roi = image(cv::Rect(3, 2, 5, 4));
+    cache.add(1, 100, roi);
+
+    cv::Mat found;
+    ASSERT_TRUE(cache.find(1, 100, found));
+    EXPECT_EQ(4, found.rows);
+    EXPECT_EQ(5, found.cols);
+    EXPECT_EQ(42, found.at<uint8_t>(0, 0));
+    file_util::remove_directory(dir);
+}
+
+TEST(decoded_cache, size_limit)
+{
+    string dir = file_util::make_temp_directory();
+    cv::Mat image = make_image(10, 10, 1);
+    decoded_cache cache(dir, 1024);
+
+    for(uint64_t key=0; key<10; key++) {
+        cache.add(key, 100, image);
+    }
+    // 300 bytes of pixels plus a header per entry
+    EXPECT_EQ(3, cache.entry_count());
+    EXPECT_LE(cache.size_bytes(), 1024);
+
+    cv::Mat found;
+    EXPECT_TRUE(cache.find(0, 100, found));
+    EXPECT_FALSE(cache.find(9, 100, found));
+    file_util::remove_directory(dir);
+}
+
+TEST(decoded_cache, open)
+{
+    string dir = file_util::make_temp_directory();
+    auto a = decoded_cache::open(dir, 1 << 20);
+    auto b = decoded_cache::open(dir, 1 << 20);
+    EXPECT_EQ(a, b);
+    auto c = decoded_cache::open(dir, 1 << 21);
+    EXPECT_NE(a, c);
+    EXPECT_EQ(c, decoded_cache::open(dir, 1 << 21));
+    file_util::remove_directory(dir);
+}
+
+TEST(output_cache, find)
+{
+    string dir = file_util::make_temp_directory();
+    nlohmann::json config = {{"height",32}, {"width",32}};
+    output_cache cache(dir, 1 << 20, config);
+
+    vector<char> encoded = {1, 2, 3, 4, 5};
+    vector<char> output(64);
+    for(size_t i=0; i<output.size(); i++) {
+        output[i] = i;
+    }
+    vector<char> found(64);
+    EXPECT_FALSE(cache.find(encoded, found.data(), found.size()));
+    cache.add(encoded, output.data(), output.size());
+    ASSERT_TRUE(cache.find(encoded, found.data(), found.size()));
+    EXPECT_EQ(output, found);
+
+    // output of another size or made with another config is not returned
+    EXPECT_FALSE(cache.find(encoded, found.data(), found.size() - 1));
+    nlohmann::json other_config = {{"height",32}, {"width",16}};
+    output_cache other(dir, 1 << 20, other_config);
+    EXPECT_FALSE(other.find(encoded, found.data(), found.size()));
+    file_util::remove_directory(dir);
+}
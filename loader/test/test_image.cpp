@@ -31,9 +31,12 @@
 #include "json.hpp"
 #include "helpers.hpp"
 #include "image.hpp"
+#include "jpeg.hpp"
 #include "log.hpp"
 #include "util.hpp"
 #include "file_util.hpp"
+#include "half.hpp"
+#include "buffer_out.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -958,6 +961,617 @@ TEST(image, var_transform_flip)
     EXPECT_TRUE(check_value(transformed,100,100,255-100,100));
 }
 
+TEST(image, param_factory_seek)
+{
+    // params are a function of the seed, epoch and record only, not of the
+    // factory that makes them or of what it made before
+    nlohmann::json js = {
+        {"height",30},
+        {"width",30},
+        {"angle",{-20,20}},
+        {"scale",{0.2,0.8}},
+        {"lighting",{0.0,0.1}},
+        {"center",false},
+        {"flip_enable",true}
+    };
+    image::config config_a(js);
+    image::config config_b(js);
+    image::param_factory factory_a(config_a);
+    image::param_factory factory_b(config_b);
+    auto decoded = make_shared<image::decoded>(cv::Mat(256, 256, CV_8UC3));
+
+    vector<shared_ptr<image::params>> forward;
+    for(uint32_t record=0; record<20; record++) {
+        factory_a.seek(1, record);
+        forward.push_back(factory_a.make_params(decoded));
+    }
+
+    int different_angles = 0;
+    for(int record=19; record>=0; record--) {
+        factory_b.seek(1, record);
+        auto params = factory_b.make_params(decoded);
+        EXPECT_EQ(forward[record]->cropbox, params->cropbox);
+        EXPECT_EQ(forward[record]->angle, params->angle);
+        EXPECT_EQ(forward[record]->flip, params->flip);
+        EXPECT_EQ(forward[record]->lighting, params->lighting);
+
+        factory_b.seek(2, record);
+        if(factory_b.make_params(decoded)->angle != params->angle) {
+            different_angles++;
+        }
+    }
+    EXPECT_GT(different_angles, 0);
+}
+
+TEST(image, jpeg_read_size)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    cv::Size2i size;
+    ASSERT_TRUE(jpeg::read_size(image_data.data(), image_data.size(), size));
+    EXPECT_EQ(cv::Size2i(480, 360), size);
+
+    vector<unsigned char> png;
+    cv::imencode(".png", generate_indexed_image(), png);
+    EXPECT_FALSE(jpeg::read_size((const char*)png.data(), png.size(), size));
+
+    // truncated before the frame header
+    EXPECT_FALSE(jpeg::read_size(image_data.data(), 20, size));
+}
+
+TEST(image, jpeg_scaled_decode)
+{
+    if(!jpeg::scaled_decode_supported()) {
+        return;
+    }
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    cv::Mat full = jpeg::decode(image_data.data(), image_data.size(), 3, 1);
+    ASSERT_EQ(cv::Size2i(480, 360), full.size());
+
+    for(int denom : {2, 4, 8}) {
+        cv::Mat scaled = jpeg::decode(image_data.data(), image_data.size(), 3, denom);
+        ASSERT_EQ(jpeg::scaled_size(full.size(), denom), scaled.size());
+
+        // DCT scaling is close to an area resize of the full decode
+        cv::Mat resized;
+        cv::resize(full, resized, scaled.size(), 0, 0, CV_INTER_AREA);
+        double mean_error = cv::norm(scaled, resized, cv::NORM_L1) / scaled.total() / 3;
+        EXPECT_LT(mean_error, 4.0) << "scale 1/" << denom;
+    }
+
+    cv::Mat gray = jpeg::decode(image_data.data(), image_data.size(), 1, 4);
+    EXPECT_EQ(1, gray.channels());
+    EXPECT_EQ(cv::Size2i(120, 90), gray.size());
+
+    EXPECT_TRUE(jpeg::decode(image_data.data(), 100, 3, 2).empty());
+}
+
+TEST(image, extract_scaled)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    nlohmann::json js = {
+        {"height",48},
+        {"width",64},
+        {"channel_major",false}
+    };
+    {
+        image::config        cfg(js);
+        image::extractor     extractor(cfg);
+        // the whole 480x360 image is cropped down to 64x48
+        EXPECT_EQ(4, extractor.decode_scale_denom(cv::Size2i(480, 360)));
+        EXPECT_EQ(1, extractor.decode_scale_denom(cv::Size2i(100, 75)));
+    }
+    {
+        js["scale"] = {0.5, 1.0};
+        image::config        cfg(js);
+        image::extractor     extractor(cfg);
+        EXPECT_EQ(2, extractor.decode_scale_denom(cv::Size2i(480, 360)));
+        js.erase("scale");
+    }
+    {
+        js["resize_short_side"] = 100;
+        image::config        cfg(js);
+        image::extractor     extractor(cfg);
+        EXPECT_EQ(2, extractor.decode_scale_denom(cv::Size2i(480, 360)));
+        js.erase("resize_short_side");
+    }
+    if(!jpeg::scaled_decode_supported()) {
+        return;
+    }
+
+    js["scale"] = {0.5, 0.5};
+    js["center"] = false;
+    image::config        cfg(js);
+    image::extractor     extractor(cfg);
+    image::param_factory factory(cfg);
+    image::transformer   transformer(cfg);
+
+    js["jpeg_scaled_decode"] = false;
+    image::config        full_cfg(js);
+    image::extractor     full_extractor(full_cfg);
+
+    auto decoded = extractor.extract(image_data.data(), image_data.size());
+    auto full    = full_extractor.extract(image_data.data(), image_data.size());
+    EXPECT_EQ(cv::Size2i(240, 180), decoded->get_image_size());
+    EXPECT_EQ(cv::Size2i(480, 360), decoded->get_source_size());
+    EXPECT_EQ(cv::Size2i(480, 360), full->get_image_size());
+    EXPECT_EQ(cv::Size2i(480, 360), full->get_source_size());
+
+    // cropboxes are made for the source image and give nearly the same output
+    // from either decode
+    for(int i=0; i<10; i++) {
+        factory.seek(0, i);
+        auto params = factory.make_params(decoded);
+        EXPECT_LE(params->cropbox.br().x, 480);
+        EXPECT_LE(params->cropbox.br().y, 360);
+        cv::Mat scaled_out = transformer.transform(params, decoded)->get_image(0);
+        cv::Mat full_out   = transformer.transform(params, full)->get_image(0);
+        ASSERT_EQ(cv::Size2i(64, 48), scaled_out.size());
+        ASSERT_EQ(cv::Size2i(64, 48), full_out.size());
+        double mean_error = cv::norm(scaled_out, full_out, cv::NORM_L1) / full_out.total() / 3;
+        EXPECT_LT(mean_error, 10.0);
+    }
+}
+
+TEST(image, jpeg_roi_decode)
+{
+    if(!jpeg::scaled_decode_supported()) {
+        return;
+    }
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    cv::Rect roi(101, 53, 200, 150);
+    for(int denom : {1, 2, 4}) {
+        cv::Mat full = jpeg::decode(image_data.data(), image_data.size(), 3, denom);
+        cv::Rect decoded_roi;
+        cv::Mat partial = jpeg::decode(image_data.data(), image_data.size(), 3, denom, roi, decoded_roi);
+        ASSERT_FALSE(partial.empty());
+        EXPECT_EQ(roi, decoded_roi & roi);
+        EXPECT_EQ(0, decoded_roi.x % denom);
+        EXPECT_EQ(0, decoded_roi.y % denom);
+
+        cv::Rect scaled_roi(decoded_roi.x / denom, decoded_roi.y / denom, partial.cols, partial.rows);
+        ASSERT_EQ(jpeg::scaled_size(decoded_roi.size(), denom), partial.size());
+        double mean_error = cv::norm(partial, full(scaled_roi), cv::NORM_L1) / partial.total() / 3;
+        EXPECT_LT(mean_error, 1.0) << "scale 1/" << denom;
+    }
+
+    // roi outside of the image
+    cv::Rect decoded_roi;
+    EXPECT_TRUE(jpeg::decode(image_data.data(), image_data.size(), 3, 1,
+                             cv::Rect(500, 0, 10, 10), decoded_roi).empty());
+}
+
+TEST(image, extract_roi)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    nlohmann::json js = {
+        {"height",48},
+        {"width",64},
+        {"scale",{0.3,0.6}},
+        {"center",false},
+        {"channel_major",false}
+    };
+    js["jpeg_roi_decode"] = false;
+    js["jpeg_scaled_decode"] = false;
+    image::config        full_cfg(js);
+    image::extractor     full_extractor(full_cfg);
+    image::param_factory full_factory(full_cfg);
+    image::transformer   transformer(full_cfg);
+
+    for(bool scaled : {false, true}) {
+        js["jpeg_roi_decode"] = true;
+        js["jpeg_scaled_decode"] = scaled;
+        image::config        cfg(js);
+        image::extractor     extractor(cfg);
+        image::param_factory factory(cfg);
+
+        for(int i=0; i<10; i++) {
+            factory.seek(0, i);
+            full_factory.seek(0, i);
+            shared_ptr<image::params> params;
+            shared_ptr<image::params> full_params;
+            auto decoded = extractor.extract(image_data.data(), image_data.size(), factory, params);
+            auto full    = full_extractor.extract(image_data.data(), image_data.size(), full_factory, full_params);
+
+            // the same params, only the part of the image they crop is decoded
+            EXPECT_EQ(full_params->cropbox, params->cropbox);
+            EXPECT_EQ(cv::Size2i(480, 360), decoded->get_source_size());
+            EXPECT_EQ(cv::Size2i(480, 360), full->get_image_size());
+            EXPECT_EQ(params->cropbox, decoded->get_source_roi() & params->cropbox);
+            EXPECT_LT(decoded->get_image_size().area(), 480 * 360 / 2);
+
+            cv::Mat roi_out  = transformer.transform(params, decoded)->get_image(0);
+            cv::Mat full_out = transformer.transform(full_params, full)->get_image(0);
+            ASSERT_EQ(cv::Size2i(64, 48), roi_out.size());
+            double mean_error = cv::norm(roi_out, full_out, cv::NORM_L1) / full_out.total() / 3;
+            if(scaled) {
+                EXPECT_LT(mean_error, 10.0);
+            } else {
+                // the decoded pixels are exactly those of the full decode,
+                // only the resize sees them at another offset
+                EXPECT_LT(mean_error, 0.1);
+            }
+        }
+    }
+}
+
+TEST(image, fused_load)
+{
+    cv::Mat source(120, 160, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols * 3; col++) {
+            p[col] = (row * 7 + col * 13 + (row * col) % 31) % 256;
+        }
+    }
+
+    // shrunk and enlarged crops, in both layouts and with conversion
+    for(string output_type : {"uint8_t", "float"}) {
+        for(bool channel_major : {true, false}) {
+            for(int width : {64, 256}) {
+                nlohmann::json js = {
+                    {"height",width * 3 / 4},
+                    {"width",width},
+                    {"scale",{0.3,0.9}},
+                    {"center",false},
+                    {"flip_enable",true},
+                    {"output_type",output_type},
+                    {"channel_major",channel_major}
+                };
+                image::config        cfg(js);
+                image::param_factory factory(cfg);
+                image::transformer   transformer(cfg);
+                image::loader        loader(cfg);
+
+                size_t byte_size = cfg.get_shape_type().get_byte_size();
+                size_t count     = byte_size / cfg.get_shape_type().get_otype().size;
+                vector<char> fused(byte_size);
+                vector<char> expected(byte_size);
+                for(int i=0; i<8; i++) {
+                    auto decoded = make_shared<image::decoded>(source);
+                    factory.seek(0, i);
+                    auto params = factory.make_params(decoded);
+                    ASSERT_TRUE(loader.fused_load({fused.data()}, decoded, params));
+                    loader.load({expected.data()}, transformer.transform(params, decoded));
+
+                    // cv::resize rounds 8 bit images in fixed point
+                    for(size_t j=0; j<count; j++) {
+                        if(output_type == "float") {
+                            ASSERT_NEAR(((float*)expected.data())[j], ((float*)fused.data())[j], 1.0);
+                        } else {
+                            ASSERT_NEAR((uint8_t)expected[j], (uint8_t)fused[j], 1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // rotation and photometric distortion need the transformer
+    auto decoded = make_shared<image::decoded>(source);
+    vector<char> outbuf(48 * 64 * 3);
+    vector<nlohmann::json> configs = {
+        nlohmann::json{{"height",48}, {"width",64}, {"angle",{10,10}}},
+        nlohmann::json{{"height",48}, {"width",64}, {"lighting",{0.0,0.1}}},
+        nlohmann::json{{"height",48}, {"width",64}, {"fused_load",false}}
+    };
+    for(auto& js : configs) {
+        image::config        cfg(js);
+        image::param_factory factory(cfg);
+        image::loader        loader(cfg);
+        EXPECT_FALSE(loader.fused_load({outbuf.data()}, decoded, factory.make_params(decoded)));
+    }
+}
+
+TEST(image, normalize)
+{
+    cv::Mat source(120, 160, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols * 3; col++) {
+            p[col] = (row * 7 + col * 13 + (row * col) % 31) % 256;
+        }
+    }
+    vector<float> mean = {0.485, 0.456, 0.406};
+    vector<float> std  = {0.229, 0.224, 0.225};
+
+    for(bool channel_major : {true, false}) {
+        for(bool fused : {true, false}) {
+            nlohmann::json js = {
+                {"height",48},
+                {"width",64},
+                {"scale",{0.3,0.9}},
+                {"output_type","float"},
+                {"channel_major",channel_major},
+                {"fused_load",fused}
+            };
+            image::config plain_cfg(js);
+            js["mean"]        = mean;
+            js["std"]         = std;
+            js["pixel_scale"] = 1.0 / 255.0;
+            image::config cfg(js);
+
+            image::param_factory factory(cfg);
+            image::transformer   transformer(cfg);
+            image::loader        loader(cfg);
+            image::loader        plain_loader(plain_cfg);
+
+            size_t count = 48 * 64 * 3;
+            vector<float> normalized(count);
+            vector<float> plain(count);
+            for(int i=0; i<4; i++) {
+                auto decoded = make_shared<image::decoded>(source);
+                factory.seek(0, i);
+                auto params = factory.make_params(decoded);
+                if(!loader.fused_load({normalized.data()}, decoded, params)) {
+                    ASSERT_FALSE(fused);
+                    loader.load({normalized.data()}, transformer.transform(params, decoded));
+                }
+                plain_loader.load({plain.data()}, transformer.transform(params, decoded));
+
+                for(size_t j=0; j<count; j++) {
+                    int c = channel_major ? j / (48 * 64) : j % 3;
+                    float expected = (plain[j] / 255.0 - mean[c]) / std[c];
+                    ASSERT_NEAR(expected, normalized[j], fused ? 1.01 / 255 / std[c] : 1e-5);
+                }
+            }
+        }
+    }
+
+    vector<nlohmann::json> invalid = {
+        nlohmann::json{{"height",48}, {"width",64}, {"mean",{0.5, 0.5, 0.5}}},
+        nlohmann::json{{"height",48}, {"width",64}, {"output_type","float"}, {"std",{0.5, 0.5}}},
+        nlohmann::json{{"height",48}, {"width",64}, {"output_type","float"}, {"std",{0.5, 0.0, 0.5}}}
+    };
+    for(auto& js : invalid) {
+        EXPECT_THROW(image::config cfg(js), std::invalid_argument);
+    }
+}
+
+TEST(image, half_output)
+{
+    cv::Mat source(120, 160, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols * 3; col++) {
+            p[col] = (row * 7 + col * 13 + (row * col) % 31) % 256;
+        }
+    }
+
+    for(string output_type : {"float16", "bfloat16"}) {
+        for(bool fused : {true, false}) {
+            nlohmann::json js = {
+                {"height",48},
+                {"width",64},
+                {"scale",{0.3,0.9}},
+                {"output_type","float"},
+                {"pixel_scale",1.0 / 255.0},
+                {"fused_load",fused}
+            };
+            image::config float_cfg(js);
+            js["output_type"] = output_type;
+            image::config cfg(js);
+            EXPECT_EQ(48 * 64 * 3 * 2, cfg.get_shape_type().get_byte_size());
+
+            image::param_factory factory(cfg);
+            image::transformer   transformer(cfg);
+            image::loader        loader(cfg);
+            image::loader        float_loader(float_cfg);
+
+            size_t count = 48 * 64 * 3;
+            vector<uint16_t> output(count);
+            vector<float>    wide(count);
+            vector<uint16_t> expected(count);
+            for(int i=0; i<4; i++) {
+                auto decoded = make_shared<image::decoded>(source);
+                factory.seek(0, i);
+                auto params = factory.make_params(decoded);
+                if(!loader.fused_load({output.data()}, decoded, params)) {
+                    ASSERT_FALSE(fused);
+                    loader.load({output.data()}, transformer.transform(params, decoded));
+                }
+                if(!float_loader.fused_load({wide.data()}, decoded, params)) {
+                    float_loader.load({wide.data()}, transformer.transform(params, decoded));
+                }
+                half::convert(wide.data(), count, cfg.get_shape_type().get_otype(), expected.data());
+                ASSERT_EQ(expected, output);
+            }
+        }
+    }
+}
+
+TEST(image, batch_convert)
+{
+    cv::Mat source(120, 160, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols * 3; col++) {
+            p[col] = (row * 7 + col * 13 + (row * col) % 31) % 256;
+        }
+    }
+
+    vector<nlohmann::json> configs = {
+        {{"output_type","float"}, {"channel_major",true}},
+        {{"output_type","float"}, {"channel_major",false}, {"mean",{127, 127, 127}}, {"std",{64, 64, 64}}},
+        {{"output_type","uint8_t"}, {"channel_major",true}},
+        {{"output_type","float16"}, {"channel_major",true}, {"pixel_scale",1.0 / 255.0}},
+        {{"output_type","float"}, {"channel_major",true}, {"angle",{-10, 10}}}
+    };
+    for(auto js : configs) {
+        js["height"]      = 48;
+        js["width"]       = 64;
+        js["scale"]       = {0.3, 0.9};
+        js["flip_enable"] = true;
+        image::config cfg(js);
+        js["batch_convert"] = true;
+        image::config batch_cfg(js);
+
+        image::param_factory factory(cfg);
+        image::transformer   transformer(cfg);
+        image::loader        loader(cfg);
+        image::loader        batch_loader(batch_cfg);
+
+        size_t     item_size = cfg.get_shape_type().get_byte_size();
+        int        items     = 5;
+        buffer_out expected(item_size, items);
+        buffer_out batch(item_size, items);
+        for(int i=0; i<items; i++) {
+            auto decoded = make_shared<image::decoded>(source);
+            factory.seek(0, i);
+            auto params = factory.make_params(decoded);
+            if(!loader.fused_load({expected.get_item(i)}, decoded, params)) {
+                loader.load({expected.get_item(i)}, transformer.transform(params, decoded));
+            }
+            if(!batch_loader.fused_load({batch.get_item(i)}, decoded, params)) {
+                batch_loader.load({batch.get_item(i)}, transformer.transform(params, decoded));
+            }
+        }
+        batch_loader.post_process(batch);
+        ASSERT_EQ(0, memcmp(expected.data(), batch.data(), item_size * items)) << js.dump();
+    }
+
+    nlohmann::json js = {{"height",48}, {"width",64}, {"output_type","int8_t"}, {"batch_convert",true}};
+    EXPECT_THROW(image::config{js}, std::invalid_argument);
+}
+
+TEST(image, deterministic)
+{
+    nlohmann::json js = {{"height",32}, {"width",32}};
+    EXPECT_TRUE(image::config(js).deterministic());
+    js["scale"] = {0.5, 0.5};
+    EXPECT_TRUE(image::config(js).deterministic());
+
+    vector<nlohmann::json> random = {
+        {{"flip_enable",true}},
+        {{"center",false}},
+        {{"scale",{0.5, 1.0}}},
+        {{"angle",{-5, 5}}},
+        {{"lighting",{0.0, 0.1}}},
+        {{"horizontal_distortion",{0.75, 1.33}}},
+        {{"contrast",{0.9, 1.1}}},
+        {{"hue",{-10, 10}}}
+    };
+    for(auto extra : random) {
+        for(auto it = extra.begin(); it != extra.end(); it++) {
+            js[it.key()] = it.value();
+        }
+        EXPECT_FALSE(image::config(js).deterministic()) << extra.dump();
+        js = {{"height",32}, {"width",32}};
+    }
+}
+
+TEST(image, multi_crop_shared_resize)
+{
+    cv::Mat source(240, 300, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols * 3; col++) {
+            p[col] = 128 + 100 * sin(row / 31.0) * cos(col / 67.0);
+        }
+    }
+
+    nlohmann::json js = {
+        {"crop_config", {{"width",100}, {"height",100}, {"flip_enable",true}}},
+        {"crop_scales", {0.8, 0.55}}
+    };
+    multicrop::config      mc_config(js);
+    image::param_factory   factory(mc_config.crop_config);
+    image::transformer     single(mc_config.crop_config);
+    multicrop::transformer trans{mc_config};
+
+    auto decoded = make_shared<image::decoded>(source);
+    auto params  = factory.make_params(decoded);
+    auto views   = trans.transform(params, decoded);
+    ASSERT_EQ(20, views->get_image_count());
+
+    // each view matches resizing its own crop, up to a shift of less than
+    // a pixel of the resized image where its corner does not fall on it
+    cv::Size2f cropbox_size = image::cropbox_max_proportional(source.size(), params->output_size);
+    vector<cv::Point2f> offsets = {{0.5, 0.5}, {0.0, 0.0}, {0.0, 1.0}, {1.0, 0.0}, {1.0, 1.0}};
+    int index = 0;
+    for(float scale : {0.8, 0.55}) {
+        cv::Size2i boxdim = cropbox_size * scale;
+        for(const cv::Point2f& offset : offsets) {
+            cv::Point2i corner((source.cols - boxdim.width) * offset.x, (source.rows - boxdim.height) * offset.y);
+            auto view_params = make_shared<image::params>(*params);
+            view_params->cropbox = cv::Rect(corner, boxdim);
+            view_params->flip    = false;
+            cv::Mat expected = single.transform_single_image(view_params, source);
+            cv::Mat view     = views->get_image(index++);
+            cv::Mat flipped  = views->get_image(index++);
+
+            double error = 0;
+            for(int row=0; row<view.rows; row++) {
+                for(int col=0; col<view.cols * 3; col++) {
+                    error += abs(view.ptr<uint8_t>(row)[col] - expected.ptr<uint8_t>(row)[col]);
+                    ASSERT_EQ(view.ptr<uint8_t>(row)[col],
+                              flipped.ptr<uint8_t>(row)[(view.cols - 1 - col / 3) * 3 + col % 3]);
+                }
+            }
+            EXPECT_LT(error / (view.total() * 3), 2.0) << scale << " " << offset.x << " " << offset.y;
+        }
+    }
+}
+
+TEST(image, rotate_crop_resize)
+{
+    cv::Mat source(120, 160, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols * 3; col++) {
+            p[col] = 128 + 100 * sin(row / 9.0) * cos(col / 33.0);
+        }
+    }
+    cv::Rect cropbox(30, 20, 90, 72);
+
+    for(bool flip : {false, true}) {
+        // a quarter turn without scaling only moves pixels around, so the
+        // single warp picks exactly the pixels of the separate steps
+        cv::Mat rotated;
+        cv::Mat expected;
+        cv::Mat output;
+        image::rotate(source, rotated, 90, false);
+        if(flip) {
+            cv::flip(rotated(cropbox), expected, 1);
+        } else {
+            expected = rotated(cropbox);
+        }
+        image::rotate_crop_resize(source, output, 90, cropbox, cropbox.size(), flip, false);
+        ASSERT_EQ(cropbox.size(), output.size());
+        EXPECT_EQ(0, cv::norm(expected, output, cv::NORM_L1));
+
+        // scaled, they only differ in how pixels are interpolated
+        cv::Mat resized;
+        image::rotate(source, rotated, 15);
+        image::resize(rotated(cropbox), resized, cv::Size2i(64, 48));
+        if(flip) {
+            cv::flip(resized, expected, 1);
+        } else {
+            expected = resized;
+        }
+        image::rotate_crop_resize(source, output, 15, cropbox, cv::Size2i(64, 48), flip);
+        ASSERT_EQ(cv::Size2i(64, 48), output.size());
+        EXPECT_LT(cv::norm(expected, output, cv::NORM_L1) / output.total() / 3, 1.0);
+    }
+
+    // shrinking fine detail by 5x averages it out instead of aliasing
+    cv::Mat stripes(300, 400, CV_8UC3);
+    for(int row=0; row<stripes.rows; row++) {
+        uint8_t* p = stripes.ptr<uint8_t>(row);
+        for(int col=0; col<stripes.cols * 3; col++) {
+            p[col] = ((row + col / 3) % 2) * 200;
+        }
+    }
+    cv::Mat rotated;
+    cv::Mat expected;
+    cv::Mat output;
+    cv::Rect wide(50, 30, 300, 240);
+    image::rotate(stripes, rotated, 10);
+    image::resize(rotated(wide), expected, cv::Size2i(60, 48));
+    image::rotate_crop_resize(stripes, output, 10, wide, cv::Size2i(60, 48), false);
+    ASSERT_EQ(cv::Size2i(60, 48), output.size());
+    EXPECT_LT(cv::norm(expected, output, cv::NORM_L1) / output.total() / 3, 4.0);
+}
+
 bool test_contrast_image(cv::Mat m, float v1, float v2, float v3)
 {
     bool rc = true;
@@ -1197,6 +1811,58 @@ TEST(photometric, saturation)
     }
 }
 
+TEST(photometric, apply)
+{
+    cv::Mat source(128, 256, CV_8UC3);
+    for(int row=0; row<source.rows; row++) {
+        uint8_t* p = source.ptr<uint8_t>(row);
+        for(int col=0; col<source.cols; col++) {
+            *p++ = col;
+            *p++ = row * 2;
+            *p++ = (col * 3 + row * 5) % 256;
+        }
+    }
+
+    struct distortion
+    {
+        float         contrast;
+        float         brightness;
+        float         saturation;
+        int           hue;
+        vector<float> lighting;
+    };
+    vector<distortion> distortions = {
+        {1.0, 1.0, 1.0, 0,   {}},
+        {0.6, 1.0, 1.0, 0,   {}},
+        {1.0, 1.3, 1.0, 0,   {}},
+        {1.0, 0.7, 1.0, 0,   {}},
+        {1.0, 1.0, 0.5, 0,   {}},
+        {1.0, 1.0, 1.6, 0,   {}},
+        {1.0, 1.0, 1.0, 40,  {}},
+        {1.0, 1.0, 1.0, 250, {}},
+        {1.0, 1.0, 1.0, 0,   {0.1, -0.05, 0.08}},
+        {1.4, 0.8, 1.2, 100, {-0.1, 0.02, 0.05}}
+    };
+    for(auto& d : distortions) {
+        cv::Mat expected = source.clone();
+        image::photometric::cbsjitter(expected, d.contrast, d.brightness, d.saturation, d.hue);
+        image::photometric::lighting(expected, d.lighting, 0.1);
+        cv::Mat output = source.clone();
+        image::photometric::apply(output, d.contrast, d.brightness, d.saturation, d.hue, d.lighting, 0.1);
+
+        int max_error = 0;
+        for(int row=0; row<output.rows; row++) {
+            for(int col=0; col<output.cols * 3; col++) {
+                max_error = max(max_error, abs(expected.ptr<uint8_t>(row)[col] - output.ptr<uint8_t>(row)[col]));
+            }
+        }
+        // cbsjitter rounds to 8 bit HSV, which moves saturated colors the
+        // most when their hue is turned
+        EXPECT_LT(cv::norm(expected, output, cv::NORM_L1) / output.total() / 3, 1.0);
+        EXPECT_LE(max_error, 8);
+    }
+}
+
 TEST(DISABLED_photometric, hue)
 {
     cv::Mat source = cv::imread(CURDIR"/test_data/flowers.jpg");
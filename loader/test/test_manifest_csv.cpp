@@ -23,6 +23,7 @@
 #include <string>
 #include <stdexcept>
 #include <memory>
+#include <set>
 
 #include <chrono>
 
@@ -219,6 +220,54 @@ TEST(manifest, root_path)
     remove(manifest_file.c_str());
 }
 
+TEST(manifest, comments_and_last_line)
+{
+    string manifest_file = "tmp_manifest.csv";
+    {
+        ofstream f(manifest_file);
+        f << "# a comment\n";
+        f << "a0,b0\n";
+        f << "\n";
+        f << "a1,\n";
+        f << "a2,b2";
+        f.close();
+    }
+    nervana::manifest_csv manifest(manifest_file, false, "/r");
+    ASSERT_EQ(3, manifest.objectCount());
+    ASSERT_EQ(2, manifest.nelements());
+
+    vector<string> expected0 = {"/r/a0", "/r/b0"};
+    vector<string> expected1 = {"/r/a1", "/r"};
+    vector<string> expected2 = {"/r/a2", "/r/b2"};
+    EXPECT_EQ(expected0, manifest.record(0));
+    EXPECT_EQ(expected1, manifest.record(1));
+    EXPECT_EQ(expected2, *(manifest.begin() + 2));
+    EXPECT_EQ(3, manifest.end() - manifest.begin());
+    remove(manifest_file.c_str());
+}
+
+TEST(manifest, shard)
+{
+    manifest_maker mm;
+    string filename = mm.tmp_manifest_file(22, {4, 4});
+
+    // shards are disjoint, of equal size and cover all but the last
+    // 22 % shard_count records
+    set<string> seen;
+    for(int shard=0; shard<4; shard++) {
+        nervana::manifest_csv manifest(filename, true);
+        manifest.generate_shard(4, shard);
+        ASSERT_EQ(5, manifest.objectCount());
+        for(const vector<string>& x : manifest) {
+            EXPECT_TRUE(seen.insert(x[0]).second);
+        }
+    }
+    EXPECT_EQ(20, seen.size());
+
+    nervana::manifest_csv manifest(filename, true);
+    EXPECT_THROW(manifest.generate_shard(4, 4), std::exception);
+}
+
 TEST(manifest, crc)
 {
     const string input = "123456789";
@@ -235,6 +284,120 @@ TEST(manifest, crc)
     EXPECT_EQ(expected, actual);
 }
 
+TEST(manifest, crc_combine)
+{
+    // hardware and table crc agree, and crcs of pieces combine to the crc of
+    // the whole
+    string input;
+    for(int i=0; i<1000; i++) {
+        input += to_string(i * 7919);
+    }
+
+    uint32_t whole = 0;
+    CryptoPP::CRC32C crc;
+    crc.Update((const uint8_t*)input.data() + 1, input.size() - 1);
+    crc.TruncatedFinal((uint8_t*)&whole, sizeof(whole));
+
+    uint32_t bytewise = 0;
+    for(size_t i=1; i<input.size(); i++) {
+        crc.UpdateByte(input[i]);
+    }
+    crc.TruncatedFinal((uint8_t*)&bytewise, sizeof(bytewise));
+    EXPECT_EQ(bytewise, whole);
+
+    size_t split = 1234;
+    uint32_t first = 0;
+    uint32_t second = 0;
+    crc.Update((const uint8_t*)input.data() + 1, split - 1);
+    crc.TruncatedFinal((uint8_t*)&first, sizeof(first));
+    crc.Update((const uint8_t*)input.data() + split, input.size() - split);
+    crc.TruncatedFinal((uint8_t*)&second, sizeof(second));
+    EXPECT_EQ(whole, CryptoPP::CRC32C_Combine(first, second, input.size() - split));
+    EXPECT_EQ(first, CryptoPP::CRC32C_Combine(first, 0, 0));
+}
+
+TEST(manifest, parallel_parse)
+{
+    // large enough to be parsed on several threads
+    string manifest_file = file_util::tmp_filename();
+    const int count = 400000;
+    CryptoPP::CRC32C crc;
+    {
+        ofstream f(manifest_file);
+        for(int i=0; i<count; i++) {
+            string image = "images/some/long/directory/image_" + to_string(i) + ".jpg";
+            string target = "/targets/some/long/directory/target_" + to_string(i) + ".txt";
+            f << image << "," << target << "\n";
+
+            string joined = "/root/" + image + target;
+            crc.Update((const uint8_t*)joined.data(), joined.size());
+        }
+        f << "last,record,is,bad\n";
+    }
+    uint32_t expected_crc;
+    crc.TruncatedFinal((uint8_t*)&expected_crc, sizeof(expected_crc));
+
+    try {
+        nervana::manifest_csv manifest(manifest_file, false, "/root");
+        FAIL();
+    } catch (std::exception& e) {
+        string expected = "at line: " + to_string(count) +
+                          ", manifest file has a line with differing number of files (4) vs (2)";
+        EXPECT_EQ(expected, string(e.what()).substr(0, expected.size()));
+    }
+
+    // drop the bad record
+    truncate(manifest_file.c_str(), file_util::get_file_size(manifest_file) - 19);
+    nervana::manifest_csv manifest(manifest_file, false, "/root");
+    ASSERT_EQ(count, manifest.objectCount());
+    EXPECT_EQ(expected_crc, manifest.get_crc());
+
+    vector<string> expected = {"/root/images/some/long/directory/image_123456.jpg",
+                               "/targets/some/long/directory/target_123456.txt"};
+    EXPECT_EQ(expected, manifest.record(123456));
+
+    remove(manifest_file.c_str());
+}
+
+TEST(manifest, binary_index)
+{
+    manifest_maker mm;
+    string csv_file = mm.tmp_manifest_file(50, {4, 4});
+    string index_file = file_util::tmp_filename();
+
+    nervana::manifest_csv csv(csv_file, false);
+    csv.write_index(index_file);
+    EXPECT_FALSE(nervana::manifest_csv::is_likely_index(csv_file));
+    EXPECT_TRUE(nervana::manifest_csv::is_likely_index(index_file));
+
+    // same records, cache id and version as the csv file
+    nervana::manifest_csv index(index_file, false);
+    ASSERT_EQ(csv.objectCount(), index.objectCount());
+    EXPECT_EQ(csv.nelements(), index.nelements());
+    EXPECT_EQ(csv.cache_id(), index.cache_id());
+    EXPECT_EQ(csv.version(), index.version());
+    for(auto it1 = csv.begin(), it2 = index.begin(); it1 != csv.end(); ++it1, ++it2) {
+        ASSERT_EQ(*it1, *it2);
+    }
+
+    // shuffling and root apply as they do to the csv file, and change the version
+    nervana::manifest_csv csv_shuffled(csv_file, true, "/r");
+    nervana::manifest_csv index_shuffled(index_file, true, "/r");
+    for(auto it1 = csv_shuffled.begin(), it2 = index_shuffled.begin(); it1 != csv_shuffled.end(); ++it1, ++it2) {
+        ASSERT_EQ(*it1, *it2);
+    }
+    EXPECT_NE(index.version(), index_shuffled.version());
+
+    index_shuffled.generate_subset(0.5);
+    EXPECT_EQ(25, index_shuffled.objectCount());
+
+    // a truncated index is rejected
+    truncate(index_file.c_str(), 100);
+    EXPECT_THROW(nervana::manifest_csv(index_file, false), std::runtime_error);
+
+    remove(index_file.c_str());
+}
+
 //TEST(manifest, performance)
 //{
 //    string manifest_filename = file_util::tmp_filename();
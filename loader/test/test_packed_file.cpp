@@ -0,0 +1,206 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <unistd.h>
+
+#include <map>
+
+#include "gtest/gtest.h"
+#include "packed_file.hpp"
+#include "block_loader_packed_cache.hpp"
+#include "block_loader_util.hpp"
+#include "file_util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static string item_string(buffer_in& b, int i)
+{
+    vector<char>& x = b.get_item(i);
+    return string(x.data(), x.size());
+}
+
+TEST(packed_file, write_read)
+{
+    string dir = file_util::make_temp_directory();
+    string file = file_util::path_join(dir, "test.pack");
+
+    // write 26 blocks of 4 records out of order, then read them back by record
+    block_loader_alphabet source(4);
+    {
+        packed_file::writer writer(file, 26 * 4, 2);
+        for(int block=25; block>=0; block--) {
+            EXPECT_FALSE(writer.complete());
+            buffer_in_array bp(2);
+            source.load_block(bp, block);
+            writer.write_records(bp, block * 4);
+        }
+        EXPECT_TRUE(writer.complete());
+        writer.close();
+    }
+
+    packed_file::reader reader(file);
+    EXPECT_EQ(26 * 4, reader.record_count());
+    EXPECT_EQ(2, reader.elements_per_record());
+
+    size_t size;
+    const char* data = reader.element(4 * 2 + 3, 1, size);
+    EXPECT_EQ("Cd", string(data, size));
+
+    // any range, independent of the block size it was written with
+    buffer_in_array bp(2);
+    reader.read_records(bp, 6, 11);
+    ASSERT_EQ(5, bp[0]->get_item_count());
+    EXPECT_EQ("Bc", item_string(*bp[0], 0));
+    EXPECT_EQ("Cc", item_string(*bp[1], 4));
+    reader.prefetch(6, 11);
+
+    file_util::remove_directory(dir);
+}
+
+TEST(packed_file, incomplete)
+{
+    string dir = file_util::make_temp_directory();
+    string file = file_util::path_join(dir, "test.pack");
+    {
+        packed_file::writer writer(file, 10, 2);
+        block_loader_alphabet source(4);
+        buffer_in_array bp(2);
+        source.load_block(bp, 0);
+        writer.write_records(bp, 0);
+        EXPECT_TRUE(writer.contains(0, 4));
+        EXPECT_FALSE(writer.contains(2, 6));
+
+        // records already written are not added again
+        size_t size = file_util::get_file_size(file + "." + to_string(getpid()) + ".tmp");
+        writer.write_records(bp, 0);
+        EXPECT_EQ(size, file_util::get_file_size(file + "." + to_string(getpid()) + ".tmp"));
+
+        buffer_in_array back(2);
+        writer.read_records(back, 1, 3);
+        EXPECT_EQ("Ab", item_string(*back[0], 0));
+        EXPECT_EQ("Ac", item_string(*back[1], 1));
+        EXPECT_THROW(writer.close(), std::runtime_error);
+    }
+    EXPECT_FALSE(file_util::exists(file));
+    EXPECT_THROW(packed_file::reader{file}, std::runtime_error);
+
+    file_util::remove_directory(dir);
+}
+
+TEST(block_loader_packed_cache, block_size_change)
+{
+    string root = file_util::make_temp_directory();
+    string hash = block_loader_random::randomString();
+
+    // the first pass writes the cache with blocks of 4
+    {
+        block_loader_packed_cache cache(root, hash, "version123", make_shared<block_loader_alphabet>(4));
+        for(uint32_t block=0; block<cache.block_count(); block++) {
+            buffer_in_array bp(2);
+            cache.load_block(bp, block);
+        }
+        EXPECT_TRUE(cache.check_if_complete());
+    }
+
+    // reading back with blocks of 5 needs a source with the same record count
+    class alphabet_5 : public block_loader_alphabet
+    {
+    public:
+        alphabet_5() : block_loader_alphabet(5) {}
+        uint32_t object_count() override { return 26 * 4; }
+        void load_block(buffer_in_array&, uint32_t) override { FAIL() << "cache not used"; }
+    };
+    block_loader_packed_cache cache(root, hash, "version123", make_shared<alphabet_5>());
+    ASSERT_EQ(21, cache.block_count());
+
+    buffer_in_array bp(2);
+    cache.load_block(bp, 1);
+    ASSERT_EQ(5, bp[0]->get_item_count());
+    EXPECT_EQ("Bb", item_string(*bp[0], 0));
+    EXPECT_EQ("Cb", item_string(*bp[1], 4));
+
+    // last block is short
+    buffer_in_array last(2);
+    cache.load_block(last, 20);
+    EXPECT_EQ(4, last[0]->get_item_count());
+
+    file_util::remove_directory(root);
+}
+
+TEST(block_loader_packed_cache, failed_item)
+{
+    string root = file_util::make_temp_directory();
+    string hash = block_loader_random::randomString();
+
+    // record 1 of block 2 can never be read, so the cache is never complete
+    class alphabet_failing : public block_loader_alphabet
+    {
+    public:
+        alphabet_failing() : block_loader_alphabet(4) {}
+        void load_block(buffer_in_array& dest, uint32_t block_num) override
+        {
+            loads[block_num]++;
+            buffer_in_array source(dest.size());
+            block_loader_alphabet::load_block(source, block_num);
+            for(uint32_t i=0; i<source[0]->get_item_count(); i++) {
+                for(uint32_t j=0; j<dest.size(); j++) {
+                    if(block_num == 2 && i == 1) {
+                        dest[j]->add_exception(make_exception_ptr(runtime_error("unreadable")));
+                    } else {
+                        dest[j]->add_item(source[j]->get_item(i));
+                    }
+                }
+            }
+        }
+        map<uint32_t, int> loads;
+    };
+    auto source = make_shared<alphabet_failing>();
+    block_loader_packed_cache cache(root, hash, "version123", source);
+
+    string temp_file;
+    vector<size_t> sizes;
+    for(int epoch=0; epoch<2; epoch++) {
+        for(uint32_t block=0; block<cache.block_count(); block++) {
+            buffer_in_array bp(2);
+            cache.load_block(bp, block);
+            ASSERT_EQ(4, bp[0]->get_item_count());
+            if(block == 2) {
+                EXPECT_THROW(bp[0]->get_item(1), std::runtime_error);
+            } else {
+                EXPECT_EQ(string(1, 'A' + block) + "d", item_string(*bp[1], 3));
+            }
+        }
+        EXPECT_FALSE(cache.check_if_complete());
+
+        string dir = file_util::path_join(root, hash + "_version123_packed");
+        file_util::iterate_files(dir, [&](const string& file, bool is_dir) {
+            if(file.size() > 4 && file.compare(file.size() - 4, 4, ".tmp") == 0) {
+                temp_file = file;
+            }
+        });
+        ASSERT_NE("", temp_file);
+        sizes.push_back(file_util::get_file_size(temp_file));
+    }
+
+    // the second epoch only goes back to the source for the failing block and
+    // adds nothing to the file
+    EXPECT_EQ(sizes[0], sizes[1]);
+    EXPECT_EQ(25 * 4 * 2 * 2, sizes[1]);
+    EXPECT_EQ(1, source->loads[0]);
+    EXPECT_EQ(2, source->loads[2]);
+
+    file_util::remove_directory(root);
+}
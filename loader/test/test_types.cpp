@@ -20,6 +20,7 @@
 
 #include "gtest/gtest.h"
 #include "typemap.hpp"
+#include "half.hpp"
 #include <typeinfo>
 #include <typeindex>
 
@@ -36,3 +37,37 @@ TEST(typemap, numpy)
     }
 
 }
+
+TEST(typemap, half)
+{
+    output_type f16{"float16"};
+    EXPECT_EQ(NPY_FLOAT16, f16.np_type);
+    EXPECT_EQ(CV_32F, f16.cv_type);
+    EXPECT_EQ(2, f16.size);
+    EXPECT_TRUE(f16.is_half());
+
+    output_type bf16{"bfloat16"};
+    EXPECT_EQ(NPY_UINT16, bf16.np_type);
+    EXPECT_EQ(2, bf16.size);
+    EXPECT_TRUE(bf16.is_half());
+    EXPECT_FALSE(output_type{"float"}.is_half());
+
+    // enough values for both the vector loop and the remainder
+    vector<float> input = {1.0, -2.0, 0.0, 65504.0, 1e6, 1.0009765625, 1.00048828125, 1.000732421875,
+                           5.9604645e-8, 1e-9, -0.0, 0.333333343, 1.00390625, 1.005859375, 255.0, -1e-3,
+                           1.0 / 0.0};
+    vector<uint16_t> expected_f16  = {0x3c00, 0xc000, 0x0000, 0x7bff, 0x7c00, 0x3c01, 0x3c00, 0x3c01,
+                                      0x0001, 0x0000, 0x8000, 0x3555, 0x3c04, 0x3c06, 0x5bf8, 0x9419,
+                                      0x7c00};
+    vector<uint16_t> expected_bf16 = {0x3f80, 0xc000, 0x0000, 0x4780, 0x4974, 0x3f80, 0x3f80, 0x3f80,
+                                      0x3380, 0x3089, 0x8000, 0x3eab, 0x3f80, 0x3f81, 0x437f, 0xba83,
+                                      0x7f80};
+    vector<uint16_t> output(input.size());
+    half::convert(input.data(), input.size(), f16, output.data());
+    EXPECT_EQ(expected_f16, output);
+    half::convert(input.data(), input.size(), bf16, output.data());
+    EXPECT_EQ(expected_bf16, output);
+
+    EXPECT_THROW(half::convert(input.data(), input.size(), output_type{"float"}, output.data()),
+                 std::invalid_argument);
+}
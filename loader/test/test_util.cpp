@@ -27,6 +27,7 @@
 #include "wav_data.hpp"
 #include "cap_mjpeg_decoder.hpp"
 #include "image.hpp"
+#include "philox.hpp"
 
 
 #define private public
@@ -404,6 +405,35 @@ TEST(util,unbiased_round)
     EXPECT_EQ(-2, nervana::unbiased_round(-1.5));
 }
 
+TEST(util,philox)
+{
+    // known answers from the Random123 distribution
+    EXPECT_EQ((philox::counter_type{{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}),
+              philox::generate({{0, 0, 0, 0}}, {{0, 0}}));
+    EXPECT_EQ((philox::counter_type{{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}}),
+              philox::generate({{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}},
+                               {{0xffffffff, 0xffffffff}}));
+    EXPECT_EQ((philox::counter_type{{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}),
+              philox::generate({{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}},
+                               {{0xa4093822, 0x299f31d0}}));
+
+    // a stream can be entered anywhere and does not depend on the others
+    philox a(42, 1, 7);
+    vector<uint32_t> expected;
+    for(int i=0; i<10; i++) {
+        expected.push_back(a());
+    }
+    philox b(42, 1, 6);
+    b.discard(3);
+    b = philox(42, 1, 7);
+    b.discard(5);
+    for(int i=5; i<10; i++) {
+        EXPECT_EQ(expected[i], b());
+    }
+    EXPECT_NE(expected[0], philox(42, 2, 7)());
+    EXPECT_NE(expected[0], philox(43, 1, 7)());
+}
+
 TEST(DISABLED_util,dump)
 {
     string text = "this is a text string used to test the dump function.";
@@ -0,0 +1,199 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* aeon-cache-build
+ *
+ * Builds the complete cpio cache for a dataset ahead of training so that no
+ * training job starts against a cold cache.  It takes the same loader config
+ * that is handed to the dataloader, so the cache directory, block size and
+ * manifest version all match what the loader will look for.
+ *
+ * usage: aeon-cache-build [-t threads] config.json
+ *
+ * Blocks are read and written by a pool of worker threads, each holding one
+ * macrobatch in memory at a time.  Reading many small files is latency bound
+ * so the default is several threads per core; lower it with -t if
+ * macrobatches are large.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "loader.hpp"
+#include "manifest_csv.hpp"
+#include "manifest_nds.hpp"
+#include "block_loader_file.hpp"
+#include "block_loader_cpio_cache.hpp"
+#include "block_loader_packed_cache.hpp"
+
+using namespace std;
+using namespace nervana;
+
+static void usage()
+{
+    cerr << "usage: aeon-cache-build [-t threads] config.json" << endl;
+}
+
+template<typename cache_type>
+static int build_cache(cache_type& cache, block_loader_file& file_loader, uint32_t elements,
+                       int thread_count, const string& manifest_filename)
+{
+    if(cache.check_if_complete()) {
+        cout << "cache for " << manifest_filename << " is already complete" << endl;
+        return 0;
+    }
+
+    const uint32_t block_count = file_loader.block_count();
+    thread_count = min<uint32_t>(thread_count, block_count);
+
+    atomic<uint32_t> next_block{0};
+    atomic<size_t>   bytes_written{0};
+    atomic<size_t>   records_written{0};
+    mutex            error_mutex;
+    vector<string>   errors;
+
+    auto worker = [&]() {
+        uint32_t block_num;
+        while((block_num = next_block++) < block_count) {
+            try {
+                buffer_in_array block(elements);
+                file_loader.read_block(block, block_num);
+                cache.write_block_to_cache(block, block_num);
+
+                size_t bytes = 0;
+                for(int i=0; i<block[0]->get_item_count(); i++) {
+                    for(auto b : block) {
+                        bytes += b->get_item(i).size();
+                    }
+                }
+                bytes_written += bytes;
+                records_written += block[0]->get_item_count();
+            } catch(std::exception& e) {
+                lock_guard<mutex> lock(error_mutex);
+                errors.push_back("block " + to_string(block_num) + ": " + e.what());
+            }
+        }
+    };
+
+    chrono::high_resolution_clock timer;
+    auto start_time = timer.now();
+
+    vector<thread> workers;
+    for(int i=0; i<thread_count; i++) {
+        workers.emplace_back(worker);
+    }
+    for(auto& t : workers) {
+        t.join();
+    }
+
+    auto end_time = timer.now();
+    double seconds = chrono::duration_cast<chrono::milliseconds>(end_time - start_time).count() / 1000.0;
+    seconds = max(seconds, 0.001);
+
+    if(errors.size() > 0) {
+        for(const string& s : errors) {
+            cerr << "ERROR writing " << s << endl;
+        }
+        cerr << errors.size() << " of " << block_count << " blocks failed, cache not marked complete" << endl;
+        cache.release_ownership();
+        return 1;
+    }
+
+    cache.mark_cache_complete();
+    cache.release_ownership();
+
+    double mbytes = bytes_written / (1024.0 * 1024.0);
+    cout << "cached " << records_written << " records in " << block_count << " blocks";
+    cout << " using " << thread_count << " threads" << endl;
+    cout << fixed << setprecision(1);
+    cout << mbytes << " MB in " << seconds << " s: ";
+    cout << records_written / seconds << " records/s, ";
+    cout << mbytes / seconds << " MB/s" << endl;
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int thread_count = thread::hardware_concurrency() * 4;
+    int opt;
+    while((opt = getopt(argc, argv, "t:h")) != -1) {
+        switch(opt) {
+        case 't':
+            thread_count = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if(optind != argc - 1 || thread_count <= 0) {
+        usage();
+        return 1;
+    }
+
+    try {
+        nlohmann::json js;
+        ifstream config_file(argv[optind]);
+        if(!config_file) {
+            throw std::runtime_error(string("unable to open config file ") + argv[optind]);
+        }
+        config_file >> js;
+
+        loader_config lcfg(js);
+        if(lcfg.cache_directory.empty()) {
+            throw std::runtime_error("config has no cache_directory");
+        }
+        if(manifest_nds::is_likely_json(lcfg.manifest_filename)) {
+            throw std::runtime_error("aeon-cache-build only supports csv manifests");
+        }
+
+        // build the manifest, block loader and cache exactly the way loader::loader
+        // does so that the cache directory matches the one training will open
+        auto manifest = make_shared<manifest_csv>(lcfg.manifest_filename,
+                                                  lcfg.shuffle_manifest, lcfg.manifest_root);
+        if(manifest->objectCount() == 0) {
+            throw std::runtime_error("manifest file is empty");
+        }
+        auto file_loader = make_shared<block_loader_file>(manifest,
+                                                          lcfg.subset_fraction,
+                                                          lcfg.macrobatch_size,
+                                                          lcfg.shard_count,
+                                                          lcfg.shard_index);
+        string cache_id = manifest->cache_id() + lcfg.cache_id_suffix() +
+                          to_string(file_loader->object_count());
+        if(lcfg.cache_format == "packed") {
+            block_loader_packed_cache cache(lcfg.cache_directory, cache_id, manifest->version(), file_loader);
+            return build_cache(cache, *file_loader, manifest->nelements(), thread_count, lcfg.manifest_filename);
+        } else {
+            block_loader_cpio_cache cache(lcfg.cache_directory, cache_id, manifest->version(),
+                                          file_loader, lcfg.cache_max_bytes);
+            return build_cache(cache, *file_loader, manifest->nelements(), thread_count, lcfg.manifest_filename);
+        }
+    } catch(std::exception& e) {
+        cerr << "aeon-cache-build: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+/* aeon-manifest-index
+ *
+ * Precompiles a csv manifest into the binary index that manifest_csv memory
+ * maps instead of parsing.  Point manifest_filename in the loader config at
+ * the index to use it; manifest_root, shuffle_manifest and subset_fraction
+ * apply to it as they do to the csv file.
+ *
+ * usage: aeon-manifest-index manifest.csv manifest.index
+ *
+ * The index keeps the cache id of the csv file, so an unshuffled index without
+ * a manifest_root finds the cache already built from the csv file.
+ */
+
+#include <chrono>
+#include <iostream>
+
+#include "manifest_csv.hpp"
+
+using namespace std;
+using namespace nervana;
+
+int main(int argc, char** argv)
+{
+    if(argc != 3) {
+        cerr << "usage: aeon-manifest-index manifest.csv manifest.index" << endl;
+        return 1;
+    }
+
+    try {
+        chrono::high_resolution_clock timer;
+        auto start_time = timer.now();
+
+        manifest_csv manifest(argv[1], false);
+        manifest.write_index(argv[2]);
+
+        auto end_time = timer.now();
+        double seconds = chrono::duration_cast<chrono::milliseconds>(end_time - start_time).count() / 1000.0;
+        cout << "indexed " << manifest.objectCount() << " records of " << manifest.nelements();
+        cout << " fields in " << seconds << " s, version " << manifest.version() << endl;
+    } catch(std::exception& e) {
+        cerr << "aeon-manifest-index: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
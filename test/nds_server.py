@@ -29,6 +29,25 @@ def macrobatch():
     # return send_file('/usr/local/data/wdc/data/all-ingested/archive-0.cpio')
 
 
+# number of requests seen per macrobatch by the flaky routes
+flaky_requests = {}
+
+
+@app.route("/flaky/object_count/")
+def flaky_object_count():
+    return object_count()
+
+
+@app.route("/flaky/macrobatch/")
+def flaky_macrobatch():
+    """ every other request for a macrobatch fails with 503 to exercise retries """
+    index = request.args.get('macro_batch_index')
+    flaky_requests[index] = flaky_requests.get(index, 0) + 1
+    if flaky_requests[index] % 2 == 1:
+        abort(503)
+    return send_file('test.cpio')
+
+
 @app.route("/test_pattern/")
 def test_pattern():
     return '0123456789abcdef' * 1024